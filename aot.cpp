@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "aot.h"
+#include "parser.h"
+#include "server.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+
+const char* Aot::stack_limit {nullptr};
+const char* Aot::overflowed {nullptr};
+
+namespace {
+    struct Unsupported {};  // the body leaves the numeric subset
+
+    constexpr size_t max_args = 16;     // as the JIT takes them
+    constexpr size_t max_free = 16;
+
+    string literal(const string& s) {   // C++ string literal, octal escapes keep ? and \ harmless
+        string res {'"'};
+        for (unsigned char c : s) {
+            if (isalnum(c) || c == ' ' || c == '(' || c == ')' || c == '_' || c == '-' || c == '+' || c == '.') res += c;
+            else { char b[8]; snprintf(b, sizeof b, "\\%03o", c); res += b; }
+            if (c == '\n') res += "\"\n        \"";
+        }
+        return res + '"';
+    }
+
+    string number(double d) {
+        if (std::isnan(d)) return "std::numeric_limits<double>::quiet_NaN()";
+        if (std::isinf(d)) return d < 0? "-std::numeric_limits<double>::infinity()" : "std::numeric_limits<double>::infinity()";
+        char b[32];
+        snprintf(b, sizeof b, "%.17g", d);
+        string res {b};
+        if (res.find_first_of(".e") == string::npos) res += ".0";
+        return "(" + res + ")";
+    }
+
+    // translates a body the way Jit's Translator does, case by case following Parser::eval and
+    // evlist, into the C++ of one function; names it can't resolve statically are free numbers,
+    // which the guard in Jit::run checks before every call
+    class Emitter {
+    public:
+        Emitter(const string& n, const List& ps, const List& b, size_t i) : name(n), params(ps), body(b), id("p" + to_string(i)) {
+            if (params.size() > max_args) throw Unsupported{};
+            for (auto& c : params) if (c.kind != Kind::Name) throw Unsupported{};
+        }
+
+        string emit() {
+            ostringstream out;
+            size_t n = params.size();
+            string statements;
+            block(body.data(), body.data() + body.size(), statements, "            ", true);
+            out << "    double " << id << "(std::initializer_list<double> in, const double* f) {\n"
+                << "        if (static_cast<const char*>(__builtin_frame_address(0)) < Aot::stack_limit) throw Aot::Overflow{};\n"
+                << "        double a[" << max<size_t>(n, 1) << "];\n"
+                << "        std::copy(in.begin(), in.end(), a);\n"
+                << "        for (;;) {\n" << statements << "        }\n"
+                << "    }\n"
+                << "    int " << id << "_entry(double* in, const double* f, double* result, const char*) {\n"
+                << "        return Aot::enter([&]() { return " << id << "({";
+            for (size_t i = 0; i < n; ++i) out << (i? ", " : "") << "in[" << i << "]";
+            out << "}, f); }, result);\n"
+                << "    }\n";
+            return out.str();
+        }
+
+        string registration() const {
+            ostringstream out;
+            out << "    Jit::precompile(" << literal(Jit::key(params, body)) << ", " << id << "_entry, " << params.size() << ", {";
+            if (recursive) out << literal(name);
+            out << "}, {";
+            for (size_t i = 0; i < free.size(); ++i) out << (i? ", " : "") << literal(free[i]);
+            out << "});\n";
+            return out.str();
+        }
+
+    private:
+        enum class Use { Param, Self, Free };
+
+        Use resolve(const string& n, string& expr) {
+            for (size_t i = params.size(); i-- > 0;)    // the last one wins
+                if (boost::get<string>(params[i].data) == n) { expr = "a[" + to_string(i) + "]"; return Use::Param; }
+            if (n == name) { recursive = true; return Use::Self; }
+            size_t i = find(free.begin(), free.end(), n) - free.begin();
+            if (i == free.size()) {
+                if (free.size() == max_free) throw Unsupported{};
+                free.push_back(n);
+            }
+            expr = "f[" + to_string(i) + "]";
+            return Use::Free;
+        }
+        string variable(const Cell& c) {
+            string expr;
+            if (resolve(boost::get<string>(c.data), expr) == Use::Self) throw Unsupported{};
+            return expr;
+        }
+
+        static bool arithmetic(Kind k) { return k == Kind::Add || k == Kind::Sub || k == Kind::Mul || k == Kind::Div; }
+        static bool comparison(Kind k) { return k == Kind::Less || k == Kind::Greater || k == Kind::Equal; }
+
+        // a span becomes statements that return its value, or in tail position loop for a self call
+        void block(const Cell* p, const Cell* last, string& out, const string& indent, bool tail) {
+            if (p == last) throw Unsupported{};
+            if (p->kind == Kind::Cond) { cond(p + 1, last, out, indent, tail); return; }
+            if (tail && p->kind == Kind::Name && self_call(*p)) { loop(p + 1, last, out, indent); return; }
+            if (tail && p->kind == Kind::Expr) {
+                const List& l = boost::get<List>(p->data);
+                if (!l.empty() && l[0].kind == Kind::Name && self_call(l[0])) { loop(l.data() + 1, l.data() + l.size(), out, indent); return; }
+                if (l.size() == 1 && l[0].kind == Kind::Expr) { block(l.data(), l.data() + 1, out, indent, tail); return; }
+            }
+            out += indent + "return " + span(p, last) + ";\n";
+        }
+        bool self_call(const Cell& c) {
+            string expr;
+            return resolve(boost::get<string>(c.data), expr) == Use::Self;
+        }
+
+        void loop(const Cell* p, const Cell* last, string& out, const string& indent) {   // tail self call
+            size_t n = last - p;
+            if (n != params.size()) throw Unsupported{};
+            if (n == 0) { out += indent + "continue;\n"; return; }
+            out += indent + "{\n" + indent + "    double t[] {" + arguments(p, last) + "};\n"
+                + indent + "    std::copy(t, t + " + to_string(n) + ", a);\n"
+                + indent + "    continue;\n" + indent + "}\n";
+        }
+
+        void cond(const Cell* p, const Cell* last, string& out, const string& indent, bool tail) {
+            for (; p != last; ++p) {
+                if (p->kind != Kind::Expr) throw Unsupported{};
+                const List& clause = boost::get<List>(p->data);
+                if (clause.empty()) throw Unsupported{};
+                if (clause[0].kind == Kind::Else) {
+                    if (p + 1 != last) break;   // an error for the interpreter to raise
+                    if (clause.size() < 2) throw Unsupported{};
+                    block(&clause[1], &clause[1] + 1, out, indent, tail);
+                    return;
+                }
+                out += indent + "if (" + test(clause[0]) + ") {\n";
+                block(clause.data() + 1, clause.data() + clause.size(), out, indent + "    ", tail);
+                out += indent + "}\n";
+            }
+            out += indent + "throw Aot::Bail{};   // no clause matched\n";
+        }
+
+        // a span in value position, Parser::eval
+        string span(const Cell* p, const Cell* last) {
+            if (p == last) throw Unsupported{};
+            switch (p->kind) {
+                case Kind::Number: return number(boost::get<double>(p->data));
+                case Kind::Name: {
+                    string expr;
+                    if (resolve(boost::get<string>(p->data), expr) == Use::Self) return call(p + 1, last);
+                    return expr;
+                }
+                case Kind::Expr: return list(boost::get<List>(p->data));
+                case Kind::Cond: {  // statements inside a lambda called on the spot
+                    string statements;
+                    cond(p + 1, last, statements, "                ", false);
+                    return "[&]() -> double {\n" + statements + "            }()";
+                }
+                default:
+                    if (!arithmetic(p->kind)) throw Unsupported{};
+                    return fold(p->kind, p + 1, last);
+            }
+        }
+
+        // an expression, where eval and evlist followed by collapse agree
+        string list(const List& l) {
+            if (l.empty()) throw Unsupported{};
+            const Cell* p = l.data();
+            const Cell* last = p + l.size();
+            switch (p->kind) {
+                case Kind::Name: {
+                    string expr;
+                    if (resolve(boost::get<string>(p->data), expr) == Use::Self) return call(p + 1, last);
+                    if (l.size() != 1) throw Unsupported{};
+                    return expr;
+                }
+                case Kind::Number:
+                    if (l.size() != 1) throw Unsupported{};
+                    return number(boost::get<double>(p->data));
+                case Kind::Expr:
+                    if (l.size() != 1) throw Unsupported{};
+                    return list(boost::get<List>(p->data));
+                default:
+                    if (!arithmetic(p->kind)) throw Unsupported{};
+                    return fold(p->kind, p + 1, last);
+            }
+        }
+
+        string argument(const Cell& c) {    // as arguments and evlist push it
+            if (c.kind == Kind::Number) return number(boost::get<double>(c.data));
+            if (c.kind == Kind::Name) return variable(c);
+            if (c.kind == Kind::Expr) return list(boost::get<List>(c.data));
+            throw Unsupported{};
+        }
+        string arguments(const Cell* p, const Cell* last) {
+            string res;
+            for (; p != last; ++p) res += (res.empty()? "" : ", ") + argument(*p);
+            return res;
+        }
+
+        string fold(Kind k, const Cell* p, const Cell* last) {     // apply_prim on numbers, from the left
+            if (p == last) throw Unsupported{};
+            string res = argument(*p);
+            while (++p != last) res = "(" + res + " " + char(k) + " " + argument(*p) + ")";
+            return res;
+        }
+
+        string call(const Cell* p, const Cell* last) {  // to the proc itself, on the C++ stack
+            if (size_t(last - p) != params.size()) throw Unsupported{};
+            return id + "({" + arguments(p, last) + "}, f)";
+        }
+
+        string test(const Cell& c) {    // a cond test, numbers are true
+            if (c.kind == Kind::Number) return "true";
+            if (c.kind == Kind::Name) return "((void)" + variable(c) + ", true)";
+            if (c.kind != Kind::Expr) throw Unsupported{};
+            const List& l = boost::get<List>(c.data);
+            if (l.size() == 3 && comparison(l[0].kind)) {
+                string x = argument(l[1]), y = argument(l[2]);
+                if (l[0].kind == Kind::Equal) return "Aot::equal(" + x + ", " + y + ")";
+                return "(" + x + " " + char(l[0].kind) + " " + y + ")";
+            }
+            return "((void)" + list(l) + ", true)";
+        }
+
+        const string name;
+        const List& params;
+        const List& body;
+        const string id;
+        bool recursive {false};     // calls itself by name
+        vector<string> free;
+    };
+
+    void includes(const List& l, deque<string>& files) {    // every (include "file") in l
+        for (auto p = l.begin(); p != l.end(); ++p) {
+            if (p->kind == Kind::Include && p + 1 != l.end() && p[1].data.which() == 0) files.push_back(boost::get<string>(p[1].data));
+            else if (p->kind == Kind::Expr) includes(boost::get<List>(p->data), files);
+        }
+    }
+
+    // the proc a top-level form defines: (define (name params...) (body)) or (define name (lambda (params) (body)))
+    bool definition(const List& form, string& name, List& params, const List*& body) {
+        if (form.size() != 3 || form[0].kind != Kind::Define) return false;
+        if (form[1].kind == Kind::Expr && form[2].kind == Kind::Expr) {
+            const List& declaration = boost::get<List>(form[1].data);
+            if (declaration.empty() || declaration[0].kind != Kind::Name) return false;
+            name = boost::get<string>(declaration[0].data);
+            params.assign(declaration.begin() + 1, declaration.end());
+            body = &boost::get<List>(form[2].data);
+            return true;
+        }
+        if (form[1].kind == Kind::Name && form[2].kind == Kind::Expr) {
+            const List& lambda = boost::get<List>(form[2].data);
+            if (lambda.size() != 3 || lambda[0].kind != Kind::Lambda || lambda[1].kind != Kind::Expr || lambda[2].kind != Kind::Expr) return false;
+            name = boost::get<string>(form[1].data);
+            params = boost::get<List>(lambda[1].data);
+            body = &boost::get<List>(lambda[2].data);
+            return true;
+        }
+        return false;
+    }
+
+    int execute(const vector<string>& args) {   // exit status of the program args[0], found on the PATH
+        vector<char*> argv;
+        for (auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        pid_t pid = fork();
+        if (pid < 0) return -1;
+        if (pid == 0) {     // no shell, so paths need no quoting
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        int status;
+        while (waitpid(pid, &status, 0) < 0) if (errno != EINTR) return -1;
+        return WIFEXITED(status)? WEXITSTATUS(status) : -1;
+    }
+
+    string directory_of_executable() {  // where clisp was built, with aot.h, jit.h and libclisp.a
+        char b[4096];
+        ssize_t n = readlink("/proc/self/exe", b, sizeof b - 1);
+        if (n <= 0) return ".";
+        string path {b, size_t(n)};
+        auto slash = path.rfind('/');
+        return slash == string::npos? "." : path.substr(0, slash);
+    }
+}
+
+int Aot::compile(const string& script, const string& output) {
+    map<string, string> files;  // text of every script, by the name it is included as
+    deque<string> pending {script};
+    string code, registrations;
+    size_t procs {0}, native {0};
+    Interpreter reader;
+    while (!pending.empty()) {
+        string file = pending.front();
+        pending.pop_front();
+        if (files.count(file)) continue;
+        ifstream in {file};
+        if (!in) { cerr << "clisp: can't read " << file << '\n'; return 1; }
+        ostringstream text;
+        text << in.rdbuf();
+        files[file] = text.str();
+        reader.cs.set_input(new istringstream{files[file]});
+        try {
+            while (true) {
+                List form = Parser::read(reader);
+                if (form.empty()) break;
+                includes(form, pending);
+                string name;
+                List params;
+                const List* body;
+                if (!definition(form, name, params, body)) continue;
+                ++procs;
+                try {
+                    Emitter e {name, params, *body, native};
+                    code += e.emit();
+                    registrations += e.registration();
+                    ++native;
+                }
+                catch (Unsupported&) {}     // left to the embedded interpreter
+            }
+        }
+        catch (exception& e) {
+            cerr << "clisp: " << file << ": " << e.what() << '\n';
+            return 1;
+        }
+        reader.cs.reset();
+    }
+
+    string source = output + ".cpp";
+    ofstream out {source};
+    out << "// made by clisp --compile " << script << "\n"
+        << "#include <algorithm>\n#include <initializer_list>\n#include <limits>\n#include \"aot.h\"\n\n"
+        << "namespace {\n" << code << "}\n\n"
+        << "int main(int argc, char* argv[]) {\n" << registrations
+        << "    return Aot::run(argc, argv, " << literal(script) << ", {\n";
+    for (auto& f : files) out << "        {" << literal(f.first) << ",\n        " << literal(f.second) << "},\n";
+    out << "    });\n}\n";
+    out.close();
+    if (!out) { cerr << "clisp: can't write " << source << '\n'; return 1; }
+
+    string dir = directory_of_executable();
+    vector<string> command {"g++", "-std=c++11", "-O2", "-I" + dir, source, dir + "/libclisp.a", "-pthread", "-o", output};
+    if (execute(command) != 0) {
+        cerr << "clisp:";
+        for (auto& arg : command) cerr << ' ' << arg;
+        cerr << " failed, " << source << " kept\n";
+        return 1;
+    }
+    remove(source.c_str());
+    cerr << "clisp: " << native << " of " << procs << " procs compiled to C++, the rest is interpreted\n";
+    return 0;
+}
+
+int Aot::run(int argc, char* argv[], const string& main_file, map<string, string> files) {
+    Lexer::embedded = std::move(files);
+    rlimit stack;   // leave the last megabyte to the interpreter redoing a call that bailed out
+    size_t size = getrlimit(RLIMIT_STACK, &stack) || stack.rlim_cur == RLIM_INFINITY? 1 << 30 : stack.rlim_cur;
+    size = min<size_t>(size, 1 << 30);
+    stack_limit = static_cast<const char*>(__builtin_frame_address(0)) - (size > 2 << 20? size - (1 << 20) : size / 2);
+    bool print_res {false};
+    if (argc >= 2) {
+        string option {argv[1]};
+        if (option == "-p" || option == "-print") print_res = true;
+    }
+    Interpreter interp;
+    istringstream in {Lexer::embedded[main_file]};
+    Server::run(interp, in, print_res);
+    return 0;
+}
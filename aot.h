@@ -0,0 +1,40 @@
+#ifndef clispp_aot
+#define clispp_aot
+#include <map>
+#include <string>
+#include "jit.h"
+
+namespace Lexer {
+    extern double equal_threshold;      // as in lexer.h, which generated code does not need
+}
+
+// ahead of time compilation: clisp --compile foo.scm -o foo translates the top-level procs of foo.scm
+// and the files it includes that only do arithmetic on numbers, cond and calls to themselves into
+// C++, the same subset the JIT handles, and links them against libclisp.a; the program runs the
+// script on the interpreter built into it, which calls the C++ procs natively from their first call
+namespace Aot {
+    struct Bail {};     // leaves the call to the interpreter, thrown by generated code
+    struct Overflow : Bail {};  // thrown by generated code with its frames below stack_limit
+    extern const char* stack_limit;     // near the end of the stack
+    extern const char* overflowed;      // frame of the last entry that ran out of stack
+
+    // a Jit::Entry running body; once a call overflowed, the interpreter redoes it recursing on the
+    // same proc, so entries deeper than that one leave their calls to it instead of overflowing again
+    template <typename Body>
+    int enter(const Body& body, double* result) {
+        const char* frame = static_cast<const char*>(__builtin_frame_address(0));
+        if (overflowed && frame < overflowed) return 1;
+        try { *result = body(); overflowed = nullptr; return 0; }
+        catch (Overflow&) { overflowed = frame; return 1; }
+        catch (Bail&) { return 1; }
+    }
+
+    inline bool equal(double x, double y) { return x < y? y - x < Lexer::equal_threshold : x - y < Lexer::equal_threshold; }
+
+    // writes output.cpp and builds it into the program output with g++, 0 on success
+    int compile(const std::string& script, const std::string& output);
+
+    // main of the compiled program: runs main_file, files are the scripts built in by name
+    int run(int argc, char* argv[], const std::string& main_file, std::map<std::string, std::string> files);
+}
+#endif
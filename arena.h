@@ -0,0 +1,81 @@
+#ifndef clispp_arena
+#define clispp_arena
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <memory>
+#include <vector>
+
+namespace Lexer {
+    extern std::atomic<size_t> list_copies;    // every List copy constructed, shown by (stats)
+
+    // bump allocator for the parse tree of one top-level form, everything is freed at once by reset
+    class Arena {
+    public:
+        static constexpr size_t block_size = 1 << 14;
+
+        void* allocate(size_t n, size_t align) {
+            uintptr_t p = (top + align - 1) & ~(align - 1);
+            if (p + n > limit) {
+                next(n + align);
+                p = (top + align - 1) & ~(align - 1);
+            }
+            top = p + n;
+            return reinterpret_cast<void*>(p);
+        }
+        void reset() {  // keeps the first block for the next form
+            if (blocks.empty()) return;
+            blocks.resize(1);
+            set(blocks[0].get(), block_size);
+        }
+    private:
+        void next(size_t n) {
+            size_t size = n > block_size? n : block_size;
+            blocks.emplace_back(new char[size]);
+            set(blocks.back().get(), size);
+        }
+        void set(char* b, size_t size) {
+            top = reinterpret_cast<uintptr_t>(b);
+            limit = top + size;
+        }
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        uintptr_t top {0};
+        uintptr_t limit {0};
+    };
+
+    // allocates from an arena if given one, otherwise from the free store; copies always go to the
+    // free store, so anything kept beyond the form (a proc body, a quoted value) leaves the arena
+    template <typename T>
+    class Arena_allocator {
+    public:
+        using value_type = T;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        template <typename U> struct rebind { using other = Arena_allocator<U>; };
+
+        Arena_allocator() {}
+        Arena_allocator(Arena* a) : arena{a} {}
+        template <typename U>
+        Arena_allocator(const Arena_allocator<U>& a) : arena{a.arena} {}
+
+        T* allocate(size_t n) {
+            if (arena) return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        void deallocate(T* p, size_t) { if (!arena) ::operator delete(p); }
+        Arena_allocator select_on_container_copy_construction() const {
+            list_copies.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+
+        Arena* arena {nullptr};
+    };
+
+    template <typename T, typename U>
+    bool operator==(const Arena_allocator<T>& a, const Arena_allocator<U>& b) { return a.arena == b.arena; }
+    template <typename T, typename U>
+    bool operator!=(const Arena_allocator<T>& a, const Arena_allocator<U>& b) { return a.arena != b.arena; }
+}
+#endif
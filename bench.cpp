@@ -0,0 +1,186 @@
+// clisp-bench [n]
+// the workloads a small vector for List would have to speed up: parsing funcs.scm and calling its
+// procs, in time and heap allocations per form or call, and how many elements the parsed lists hold;
+// then the throughput of the f64vector kernels against funcs.scm's reduce over a list of the same n
+// numbers, in GB of doubles read and written per second, and of the kernels alone on vectors well past
+// the caches; last the time the tree walker and --closures take over the procs of funcs.scm
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include "parser.h"
+#include "vector.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+
+namespace {
+    atomic<size_t> allocs {0};
+}
+
+// counted here, the library leaves operator new alone
+void* operator new(size_t n) {
+    allocs.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n? n : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+    size_t allocations() { return allocs.load(memory_order_relaxed); }
+
+    struct Cost {
+        double us;          // per run
+        double allocs;      // per run
+    };
+
+    // runs f for at least a fifth of a second
+    template<typename F> Cost measure(F f) {
+        size_t runs = 0, before = allocations();
+        auto start = chrono::steady_clock::now();
+        chrono::duration<double> elapsed {0};
+        do {
+            f();
+            ++runs;
+            elapsed = chrono::steady_clock::now() - start;
+        } while (elapsed.count() < 0.2);
+        return {elapsed.count() / runs * 1e6, double(allocations() - before) / runs};
+    }
+
+    size_t read_all(Interpreter& interp, const string& source, map<size_t, size_t>* sizes) {
+        istringstream in {source};
+        interp.cs.set_input(in);
+        size_t forms = 0;
+        while (true) {
+            List form = Parser::read(interp);
+            if (form.empty()) break;
+            ++forms;
+            if (!sizes) continue;
+            vector<const List*> todo {&form};
+            while (!todo.empty()) {
+                const List* list = todo.back();
+                todo.pop_back();
+                ++(*sizes)[list->size()];
+                for (auto& cell : *list) if (auto l = boost::get<List>(&cell.data)) todo.push_back(l);
+            }
+        }
+        interp.cs.reset();
+        return forms;
+    }
+
+    void load(Interpreter& interp, const string& source) {
+        istringstream in {source};
+        interp.cs.set_input(in);
+        while (!interp.cs.eof()) interp.heap.end_region(Parser::eval(interp, Parser::read(interp), &interp.e0));
+        interp.cs.reset();
+    }
+
+    void call(Interpreter& interp, const string& form) {
+        istringstream in {form};
+        interp.cs.set_input(in);
+        List expr = Parser::read(interp);
+        interp.cs.reset();
+        Cost c = measure([&] { interp.heap.end_region(Parser::eval(interp, expr, &interp.e0)); });
+        printf("  %-24s %10.1f us %12.0f allocations\n", form.c_str(), c.us, c.allocs);
+    }
+
+    // seconds per evaluation of form, run for at least a fifth of a second
+    double time(Interpreter& interp, const string& form) {
+        istringstream in {form};
+        interp.cs.set_input(in);
+        List expr = Parser::read(interp);
+        interp.cs.reset();
+        size_t runs = 0;
+        auto start = chrono::steady_clock::now();
+        chrono::duration<double> elapsed {0};
+        do {
+            interp.heap.end_region(Parser::eval(interp, expr, &interp.e0));
+            ++runs;
+            elapsed = chrono::steady_clock::now() - start;
+        } while (elapsed.count() < 0.2);
+        return elapsed.count() / runs;
+    }
+
+    void row(Interpreter& interp, const string& form, size_t doubles) {
+        double s = time(interp, form);
+        printf("  %-24s %10.4g GB/s %12.1f us\n", form.c_str(), doubles * sizeof(double) / s / 1e9, s * 1e6);
+    }
+
+    void compare(Interpreter& walker, Interpreter& closures, const string& form) {
+        double w = time(walker, form);
+        double c = time(closures, form);
+        printf("  %-32s %10.1f us %10.1f us %8.2fx\n", form.c_str(), w * 1e6, c * 1e6, w / c);
+    }
+
+    void bind(Interpreter& interp, size_t n, bool list) {   // v and w, and the same numbers in l
+        auto v = make_shared<vector<double>>(n);
+        List l;
+        for (size_t i = 0; i < n; ++i) {
+            (*v)[i] = (i % 1000) * 0.5;
+            if (list) l.push_back((*v)[i]);
+        }
+        interp.e0["l"] = Cell{std::move(l)};
+        interp.e0["w"] = Cell{F64vector{make_shared<vector<double>>(*v)}};   // apart from v, so both are read
+        interp.e0["v"] = Cell{F64vector{std::move(v)}};
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1? stoul(argv[1]) : 10000;
+    ifstream file {"funcs.scm"};
+    if (!file) { printf("funcs.scm not found\n"); return 1; }
+    string funcs {istreambuf_iterator<char>{file}, istreambuf_iterator<char>{}};
+    Interpreter interp;
+
+    map<size_t, size_t> sizes;
+    size_t forms = read_all(interp, funcs, &sizes);
+    Cost c = measure([&] { read_all(interp, funcs, nullptr); });
+    size_t lists = 0, small = 0;
+    for (auto& s : sizes) {
+        lists += s.second;
+        if (s.first <= 4) small += s.second;
+    }
+    printf("parsing funcs.scm, %zu forms\n", forms);
+    printf("  %10.2f us %10.1f allocations per form\n", c.us / forms, c.allocs / forms);
+    printf("  %10.1f lists per form, %.0f%% of them with at most 4 elements\n", double(lists) / forms, 100.0 * small / lists);
+
+    load(interp, funcs);
+    printf("calls into funcs.scm\n");
+    call(interp, "(linear-sum 1 1000)");
+    call(interp, "(fib-naive 15)");
+    call(interp, "(factorial 20)");
+    call(interp, "(gcd 1071 462)");
+
+    printf("f64vector kernels: %s\n%zu numbers\n", Vector::isa(), n);
+    bind(interp, n, true);
+    row(interp, "(reduce add 0 l)", n);
+    row(interp, "(f64vector-sum v)", n);
+    row(interp, "(list->f64vector l)", 2 * n);
+    size_t big = 1 << 21;
+    printf("%zu numbers\n", big);
+    bind(interp, big, false);
+    row(interp, "(f64vector-sum v)", big);
+    row(interp, "(f64vector-dot v w)", 2 * big);
+    row(interp, "(f64vector-max v)", big);
+    row(interp, "(+ v w)", 3 * big);
+    row(interp, "(* v 2)", 2 * big);
+
+    // procs the JIT leaves to the interpreter, as they take procs or lists
+    Interpreter closures;
+    closures.mode = Interpreter::Mode::Closures;
+    load(closures, funcs);
+    for (Interpreter* i : {&interp, &closures}) bind(*i, size_t{1000}, true);
+    printf("funcs.scm %35s %13s\n", "walker", "--closures");
+    compare(interp, closures, "(linear-sum 1 10000)");
+    compare(interp, closures, "(reduce add 0 (map inc l))");
+    compare(interp, closures, "(map (compose inc inc) l)");
+    compare(interp, closures, "(filter even? l)");
+    return 0;
+}
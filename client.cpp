@@ -0,0 +1,58 @@
+// clisp-client socket [expressions...]
+// sends each argument, or else each line of stdin, as one request to ./clisp --serve
+// and prints the results as they stream back
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+static bool read_exact(int fd, char* buf, size_t n) {
+    for (size_t done = 0; done < n; ) {
+        ssize_t got = read(fd, buf + done, n - done);
+        if (got <= 0) return false;
+        done += got;
+    }
+    return true;
+}
+
+static bool request(int fd, const string& text) {
+    uint32_t n = text.size();
+    string msg = string{char(n >> 24), char(n >> 16), char(n >> 8), char(n)} + text;
+    if (write(fd, msg.data(), msg.size()) != static_cast<ssize_t>(msg.size())) return false;
+    while (true) {  // one frame per result, an empty frame ends the request
+        unsigned char len[4];
+        if (!read_exact(fd, reinterpret_cast<char*>(len), 4)) return false;
+        string result(uint32_t(len[0]) << 24 | uint32_t(len[1]) << 16 | uint32_t(len[2]) << 8 | len[3], '\0');
+        if (result.empty()) return true;
+        if (!read_exact(fd, &result[0], result.size())) return false;
+        cout << result << flush;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) { cerr << "usage: clisp-client socket [expressions...]\n"; return 1; }
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[1], sizeof addr.sun_path - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+        cerr << "cannot connect to " << argv[1] << ": " << strerror(errno) << '\n';
+        return 1;
+    }
+    if (argc > 2) {
+        for (int i = 2; i < argc; ++i)
+            if (!request(fd, argv[i])) return 1;
+    }
+    else {
+        string line;
+        while (getline(cin, line))
+            if (!line.empty() && !request(fd, line)) return 1;
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,1215 @@
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <fstream>
+#include "compile.h"
+#include "jit.h"
+#include "optimize.h"
+#include "memo.h"
+#include "parallel.h"
+#include "interpreter.h"
+#include "error.h"
+
+using namespace std;
+using Parser::Span;
+using Parser::Values;
+
+atomic<size_t> Compile::inlined {0};
+atomic<size_t> Compile::deopts {0};
+atomic<size_t> Compile::misses {0};
+atomic<size_t> Compile::specialized {0};
+atomic<size_t> Compile::despecialized {0};
+
+namespace Compile {
+    struct Tail {   // a call in tail position, made by run instead of the node that found it
+        Cell fn;
+        Env* env;
+        const Node* next;
+        size_t frames;  // frame stack depth when run began
+    };
+
+    class Node {
+    public:
+        Node(bool s) : simple{s} {}
+        virtual ~Node() {}
+        // what Parser::eval gives for the span this node was compiled from; tail is null for simple nodes
+        virtual Cell eval(Interpreter& interp, Env* env, Tail* tail) const = 0;
+        const bool simple;  // never makes a tail call or leaves a frame pushed, so needs no trampoline
+    };
+}
+
+namespace Compile {
+namespace {
+    // the tree walker's eval loop: runs node, then whatever it left to be called in tail position
+    Cell run(Interpreter& interp, const Node* node, Env* env) {
+        Parser::Unwind unwind {interp};
+        Roots roots {interp.heap};
+        Tail tail {{}, nullptr, nullptr, unwind.depth()};
+        while (true) {
+            roots.clear();
+            roots.add(env);
+            roots.add(&tail.fn);
+            tail.next = nullptr;
+            Cell res = node->eval(interp, env, &tail);
+            if (!tail.next) return res;
+            node = tail.next;
+            env = tail.env;
+        }
+    }
+
+    Cell value(Interpreter& interp, const Node* node, Env* env) {  // a nested eval
+        return node->simple? node->eval(interp, env, nullptr) : run(interp, node, env);
+    }
+
+    // frames the compiled code knows the layout of: a proc's params or a let's names, in binding order
+    struct Scope {
+        const Scope* outer;     // null past the proc frame, closures may be flattened onto any frame
+        vector<const string*> names;
+        bool known;     // nothing else can be bound in the frame, it never gets defined into
+        bool slots;     // bound by Env::bind, so names[i] is slot i
+        bool top;       // with no outer, the frame's parent is the env the form runs in
+    };
+
+    // where a name looked up in the form's env was last found, so the lookup is a load until something
+    // is defined into that env. Frozen envs shared by forks are the only ones looked up from several
+    // threads, and never change, so they all fill the cache with the same binding
+    class Cache {
+    public:
+        const Cell& lookup(Env* env, const string& name) const {
+            if (from.load(memory_order_acquire) == env && epoch.load(memory_order_relaxed) == env->epoch())
+                return *cell.load(memory_order_relaxed);
+            misses.fetch_add(1, memory_order_relaxed);
+            bool fixed = true;  // the frames past env it was found through never change either
+            for (Env* e = env; e; e = e->parent()) {
+                if (const Cell* c = e->local(name)) {
+                    if (fixed) {
+                        cell.store(c, memory_order_relaxed);
+                        epoch.store(env->epoch(), memory_order_relaxed);
+                        from.store(env, memory_order_release);
+                    }
+                    return *c;
+                }
+                if (e->parent() && !e->parent()->is_frozen()) fixed = false;
+            }
+            throw runtime_error("Unbound variable");
+        }
+    private:
+        mutable atomic<Env*> from {nullptr};
+        mutable atomic<size_t> epoch {0};
+        mutable atomic<const Cell*> cell {nullptr};
+    };
+
+    struct Ref {    // a variable, skipping the frames that cannot bind it
+        const string* name;
+        int depth;
+        int index;  // slot in the frame at depth, or -1 to look the name up from there
+        const Cache* cache;     // for a lookup in the form's env
+        const Cell& get(Env* env) const {
+            for (int d = depth; d > 0; --d) env = env->parent();
+            if (index >= 0) return env->slot(index);
+            return cache? cache->lookup(env, *name) : env->lookup(*name);
+        }
+    };
+
+    Ref resolve(const string& name, const Scope* scope) {
+        int depth = 0;
+        for (; scope && scope->known; scope = scope->outer, ++depth)
+            for (size_t i = scope->names.size(); i-- > 0;)  // the last binding wins
+                if (*scope->names[i] == name) return {&name, depth, scope->slots? int(i) : -1, nullptr};
+        return {&name, depth, -1, nullptr};
+    }
+
+    bool local(const string& name, const Scope* scope) {    // bound in a frame that never changes
+        for (; scope && scope->known; scope = scope->outer)
+            for (auto n : scope->names) if (*n == name) return true;
+        return false;
+    }
+
+    bool global(const string& name, const Scope* scope) {   // looked up in the form's env
+        for (; scope; scope = scope->outer) {
+            if (!scope->known) return false;
+            for (auto n : scope->names) if (*n == name) return false;
+            if (!scope->outer) return scope->top;
+        }
+        return true;
+    }
+
+    struct Operand {    // a number or a variable, as the arguments of a call are read
+        const Cell* constant;
+        Ref ref;
+        const Cell& get(Env* env) const { return constant? *constant : ref.get(env); }
+    };
+
+    class Steps;
+
+    class Step {    // what evlist does at one cell, returning the cell it goes on at
+    public:
+        virtual ~Step() {}
+        virtual const Cell* run(Interpreter& interp, Env* env, size_t start) const = 0;
+    };
+
+    // evlist over every suffix of one span, indexed by the cell a suffix starts at
+    class Steps {
+    public:
+        Steps(const Cell* f, const Cell* l) : first{f}, last{l}, at(l - f) {}
+        void run(Interpreter& interp, Env* env, const Cell* from) const {
+            size_t start = interp.values.size();    // include drops what this evlist pushed
+            while (from != last) from = at[from - first]->run(interp, env, start);
+        }
+        const Cell* first;
+        const Cell* last;
+        vector<const Step*> at;     // null for cells evlist never starts at
+    };
+
+    struct Args {   // the arguments after a proc name, as Parser's arguments evaluates them
+        vector<Operand> simple;
+        const Steps* steps {nullptr};   // evlist of the rest, from the first argument that is not simple
+        const Cell* rest {nullptr};
+        const Cell* first {nullptr};    // all of them, where Parallel may fork them
+        const Cell* last {nullptr};
+        const Parallel::Evaluator* fork {nullptr};
+        void push(Interpreter& interp, Env* env) const {
+            if (fork && Parallel::fork(interp, {first, last}, env, fork)) return;
+            for (auto& o : simple) interp.values.push_back(o.get(env));
+            if (steps) steps->run(interp, env, rest);
+        }
+    };
+
+    // calls proc with the arguments on the value stack from base, in tail position when tail is given
+    Cell call(Interpreter& interp, Cell& fn, size_t base, Tail* tail) {
+        const Proc* proc = boost::get<Proc*>(fn.data);
+        if (!tail || !proc->code) return Compile::call(interp, fn, base);
+        Cell res;
+        if (Memo::run(interp, fn, base, res) || Jit::run(interp, fn, base, res)) return res;
+        interp.stack.unwind(tail->frames);  // nothing refers to the frames of this evaluation any more
+        Env* frame = Parser::enter(interp, fn, base);
+        tail->next = proc->code.get();
+        tail->fn = std::move(fn);
+        tail->env = frame;
+        return {};
+    }
+
+    // the compiled nodes, each mirrors one case of Parser::eval
+
+    class Const : public Node {
+    public:
+        Const(const Cell& c) : Node{true}, cell(c) {}
+        Cell eval(Interpreter&, Env*, Tail*) const override { return cell; }
+    private:
+        const Cell& cell;
+    };
+
+    class Nothing : public Node {
+    public:
+        Nothing() : Node{true} {}
+        Cell eval(Interpreter&, Env*, Tail*) const override { return {}; }
+    };
+
+    class Throw : public Node {     // a form the tree walker rejects when it gets to it
+    public:
+        Throw(const char* m) : Node{true}, msg{m} {}
+        Cell eval(Interpreter&, Env*, Tail*) const override { throw runtime_error(msg); }
+    private:
+        const char* msg;
+    };
+
+    class Walk : public Node {      // anything irregular is left to the tree walker
+    public:
+        Walk(Span s) : Node{true}, span{s} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override { return Parser::eval(interp, span, env); }
+    private:
+        Span span;
+    };
+
+    class Include : public Node {
+    public:
+        Include(const string& f) : Node{true}, file(f) {}
+        Cell eval(Interpreter& interp, Env*, Tail*) const override {
+            interp.cs.include(file);
+            return {Kind::Include};
+        }
+    private:
+        const string& file;
+    };
+
+    class Stats : public Node {
+    public:
+        Stats() : Node{true} {}
+        Cell eval(Interpreter& interp, Env*, Tail*) const override { return {interp.stats()}; }
+    };
+
+    class Variable : public Node {  // (name args...), the value of name or a call
+    public:
+        Variable(Ref r, Args a) : Node{false}, ref(r), args(std::move(a)) {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            const Cell& x = ref.get(env);
+            if (x.kind != Kind::Proc) return x;
+            Cell fn {x};
+            Roots roots {interp.heap};
+            roots.add(&fn);
+            size_t base = interp.values.size();
+            args.push(interp, env);
+            return call(interp, fn, base, tail);
+        }
+    private:
+        Ref ref;
+        Args args;
+    };
+
+    class Expr : public Node {  // ((...) ...), a call if the list starts with a proc, else its evlist
+    public:
+        Expr(bool h, Ref r, Args a, const Steps* s, const Cell* f)
+            : Node{false}, head{h}, ref(r), args(std::move(a)), steps{s}, first{f} {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            if (head) {
+                const Cell& x = ref.get(env);
+                if (x.kind == Kind::Proc) {
+                    Cell fn {x};
+                    Roots roots {interp.heap};
+                    roots.add(&fn);
+                    size_t base = interp.values.size();
+                    args.push(interp, env);
+                    return call(interp, fn, base, tail);
+                }
+            }
+            List& values = interp.values;
+            size_t base = values.size();
+            steps->run(interp, env, first);
+            Parser::collapse(values, base);
+            Cell res {std::move(values.back())};
+            values.pop_back();
+            return res;
+        }
+    private:
+        bool head;  // the list starts with a name, which may be a proc
+        Ref ref;
+        Args args;
+        const Steps* steps;
+        const Cell* first;
+    };
+
+    class Begin : public Node {
+    public:
+        Begin(const Steps* s, const Node* l) : Node{false}, steps{s}, last{l} {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            List& values = interp.values;
+            size_t base = values.size();
+            steps->run(interp, env, steps->first);
+            values.erase(values.begin() + base, values.end());
+            return last->eval(interp, env, tail);
+        }
+    private:
+        const Steps* steps;
+        const Node* last;
+    };
+
+    class Unit;
+
+    class Lambda : public Node {
+    public:
+        Lambda(const Unit& u, const List& p, const List& b, const Node* c) : Node{true}, unit(u), params(p), body(b), code{c} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override;
+    private:
+        const Unit& unit;
+        const List& params;
+        const List& body;
+        const Node* code;
+    };
+
+    class Define : public Node {    // (define name expr)
+    public:
+        Define(const string& n, const Node* v) : Node{true}, name(n), value{v} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override {
+            Cell v = Compile::value(interp, value, env);
+            (*env)[name] = v;
+            interp.heap.barrier(env);
+            return v;
+        }
+    private:
+        const string& name;
+        const Node* value;
+    };
+
+    class Define_proc : public Node {   // (define (name params...) body), or define-memo when memo is set
+    public:
+        Define_proc(const Unit& u, const string& n, List p, const List& b, const Node* c, bool m, Span r)
+            : Node{true}, unit(u), name(n), params(std::move(p)), body(b), code{c}, memo{m}, rest{r} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override;
+    private:
+        const Unit& unit;
+        const string& name;
+        List params;
+        const List& body;
+        const Node* code;
+        bool memo;
+        Span rest;  // after the body, the capacity define-memo may give
+    };
+
+    class Let : public Node {
+    public:
+        struct Binding { const string* name; const Node* value; };
+        Let(vector<Binding> b, bool e, bool d, const Node* bd) : Node{false}, bindings(std::move(b)), escapes{e}, defines{d}, body{bd} {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            Env* localenv = escapes? interp.heap.make_env(env) : interp.stack.push(env);
+            Roots roots {interp.heap};
+            roots.add(localenv);
+            for (auto& b : bindings) {
+                Cell v = Compile::value(interp, b.value, env);
+                if (escapes) {
+                    (*localenv)[*b.name] = std::move(v);
+                    interp.heap.barrier(localenv);
+                }
+                else localenv->bind(*b.name, std::move(v));
+            }
+            if (escapes && !defines) localenv->seal();
+            return body->eval(interp, localenv, tail);
+        }
+    private:
+        vector<Binding> bindings;
+        bool escapes, defines;
+        const Node* body;
+    };
+
+    class Cond : public Node {
+    public:
+        struct Clause { const Node* test; const Node* body; };  // test is null for else
+        Cond(vector<Clause> c) : Node{false}, clauses(std::move(c)) {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            for (size_t i = 0; i < clauses.size(); ++i) {
+                const Clause& c = clauses[i];
+                if (!c.test) {
+                    if (i + 1 != clauses.size()) throw runtime_error("Else clause not at end of condition");
+                    return c.body->eval(interp, env, tail);
+                }
+                Cell t = Compile::value(interp, c.test, env);
+                if (t) return c.body->eval(interp, env, tail);
+            }
+            throw runtime_error("No cond clause matched");
+        }
+    private:
+        vector<Clause> clauses;
+    };
+
+    // ((cond ...) ...) as evlist runs it, which goes on after the clause that matched unless it was the last
+    class Cond_expr : public Node {
+    public:
+        struct Clause { const Node* test; const Node* body; const Steps* rest; const Cell* next; };   // rest is null for the last
+        Cond_expr(vector<Clause> c) : Node{false}, clauses(std::move(c)) {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            List& values = interp.values;
+            size_t base = values.size();
+            for (size_t i = 0; i < clauses.size(); ++i) {
+                const Clause& c = clauses[i];
+                if (!c.test) {
+                    if (i + 1 != clauses.size()) throw runtime_error("Else clause not at end of condition");
+                }
+                else if (!Compile::value(interp, c.test, env)) continue;
+                if (!c.rest) return c.body->eval(interp, env, tail);
+                values.push_back(value(interp, c.body, env));
+                c.rest->run(interp, env, c.next);
+                Parser::collapse(values, base);
+                Cell res {std::move(values.back())};
+                values.pop_back();
+                return res;
+            }
+            throw runtime_error("No cond clause matched");
+        }
+    private:
+        vector<Clause> clauses;
+    };
+
+    class Memoize : public Node {   // (memoize proc [capacity])
+    public:
+        Memoize(Args a) : Node{true}, args(std::move(a)) {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override {
+            List& values = interp.values;
+            size_t base = values.size();
+            args.push(interp, env);
+            Cell res = Memo::memoize(interp, {values.data() + base, values.data() + values.size()});
+            values.erase(values.begin() + base, values.end());
+            return res;
+        }
+    private:
+        Args args;
+    };
+
+    class Primitive : public Node {
+    public:
+        Primitive(const Cell& p, const Steps* s, const Cell* f, const Parallel::Evaluator* k)
+            : Node{true}, prim(p), steps{s}, first{f}, fork{k} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override {
+            List& values = interp.values;
+            size_t base = values.size();
+            if (!fork || !Parallel::fork(interp, {first, steps->last}, env, fork)) steps->run(interp, env, first);
+            Cell res = Parser::apply_prim(prim, {values.data() + base, values.data() + values.size()});
+            values.erase(values.begin() + base, values.end());
+            return res;
+        }
+    private:
+        const Cell& prim;
+        const Steps* steps;
+        const Cell* first;
+        const Parallel::Evaluator* fork;    // where the arguments may go to Parallel
+    };
+
+    class Access : public Node {    // car, cdr or empty? of a variable, read in place
+    public:
+        Access(const Cell& p, Ref r, const Node* g) : Node{true}, prim(p), ref(r), generic{g} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override {
+            const Cell& x = ref.get(env);
+            if (x.kind != Kind::Proc) return Parser::access(prim, x);
+            return generic->eval(interp, env, nullptr);
+        }
+    private:
+        const Cell& prim;
+        Ref ref;
+        const Node* generic;
+    };
+
+    // a call to a proc compiled into its body while the name holds that very proc; the first time
+    // it holds anything else the site goes back to the call for good
+    class Inline : public Node {
+    public:
+        Inline(Ref r, size_t s, const Node* b, const Node* g)
+            : Node{b->simple && g->simple}, ref(r), serial{s}, body{b}, generic{g} {}
+        Cell eval(Interpreter& interp, Env* env, Tail* tail) const override {
+            if (!deoptimized.load(memory_order_relaxed)) {
+                const Cell& x = ref.get(env);
+                if (x.kind == Kind::Proc && boost::get<Proc*>(x.data)->serial == serial) return body->eval(interp, env, tail);
+                if (!deoptimized.exchange(true, memory_order_relaxed)) deopts.fetch_add(1, memory_order_relaxed);
+            }
+            return generic->eval(interp, env, tail);
+        }
+    private:
+        Ref ref;
+        size_t serial;
+        const Node* body;
+        const Node* generic;
+        mutable atomic<bool> deoptimized {false};  // forms may run on several threads
+    };
+
+    struct Argument {   // a number, a variable or, when expr is set, an expression
+        Operand operand;
+        const Node* expr;
+    };
+
+    constexpr unsigned specialize_after = 8;    // runs of an arithmetic site given only numbers
+
+    // a primitive of numbers whose arguments are numbers, variables and expressions. The site first
+    // applies it through the value stack, watching what it is given; once it was given only numbers
+    // specialize_after times it reads them as doubles where they are, and goes back to the value
+    // stack for good the first time one is not a number
+    class Arithmetic : public Node {
+    public:
+        Arithmetic(const Cell& p, vector<Argument> a, const Cell* c, const Steps* s)
+            : Node{true}, prim(p), args(std::move(a)), cells{c}, steps{s} {}
+        Cell eval(Interpreter& interp, Env* env, Tail*) const override {
+            State st = state.load(memory_order_relaxed);
+            if (st == Numbers) return numbers(interp, env);
+            size_t base = interp.values.size();
+            bool only_numbers = push(interp, env, 0);
+            if (st == Profiling) {
+                if (!only_numbers) state.compare_exchange_strong(st, Generic, memory_order_relaxed);
+                else if (seen.fetch_add(1, memory_order_relaxed) + 1 == specialize_after
+                        && state.compare_exchange_strong(st, Numbers, memory_order_relaxed))
+                    specialized.fetch_add(1, memory_order_relaxed);
+            }
+            return apply(interp, base);
+        }
+        static bool applies(Kind k, size_t n) {     // n arguments
+            if (k == Kind::Add || k == Kind::Sub || k == Kind::Mul || k == Kind::Div) return n >= 2;
+            return (k == Kind::Less || k == Kind::Greater || k == Kind::Equal) && n == 2;
+        }
+    private:
+        enum State : unsigned char { Profiling, Numbers, Generic };
+
+        Cell numbers(Interpreter& interp, Env* env) const {
+            double x = 0, y = 0;
+            for (size_t i = 0; i < args.size(); ++i) {
+                Cell v;
+                const Cell& c = args[i].expr? (v = value(interp, args[i].expr, env)) : args[i].operand.get(env);
+                if (c.kind != Kind::Number) return deoptimize(interp, env, i, x, c);
+                y = boost::get<double>(c.data);
+                if (i == 0) x = y;
+                else switch (prim.kind) {
+                    case Kind::Add: x += y; break;
+                    case Kind::Sub: x -= y; break;
+                    case Kind::Mul: x *= y; break;
+                    case Kind::Div: x /= y; break;
+                    default: break;     // comparisons take two
+                }
+            }
+            switch (prim.kind) {
+                case Kind::Less: return Cell{x < y};
+                case Kind::Greater: return Cell{y < x};
+                case Kind::Equal: return Cell{x < y? y - x < equal_threshold : x - y < equal_threshold};
+                default: return {x};
+            }
+        }
+
+        // argument i was not a number: what the value stack gives, the numbers before it being
+        // folded into x, which primitives of more than two numbers fold from the left anyway
+        Cell deoptimize(Interpreter& interp, Env* env, size_t i, double x, const Cell& c) const {
+            State expected = Numbers;
+            if (state.compare_exchange_strong(expected, Generic, memory_order_relaxed)) despecialized.fetch_add(1, memory_order_relaxed);
+            size_t base = interp.values.size();
+            if (i > 0) interp.values.push_back({x});
+            if (!args[i].expr && c.kind == Kind::Proc) steps->run(interp, env, cells + i);
+            else {
+                interp.values.push_back(c);
+                push(interp, env, i + 1);
+            }
+            return apply(interp, base);
+        }
+
+        // pushes the arguments from i on as evlist does, true when it only pushed numbers. A variable
+        // holding a proc is called by evlist with the rest of the arguments
+        bool push(Interpreter& interp, Env* env, size_t i) const {
+            bool numbers = true;
+            for (; i < args.size(); ++i) {
+                if (args[i].expr) interp.values.push_back(value(interp, args[i].expr, env));
+                else {
+                    const Cell& c = args[i].operand.get(env);
+                    if (c.kind == Kind::Proc) {
+                        steps->run(interp, env, cells + i);
+                        return false;
+                    }
+                    interp.values.push_back(c);
+                }
+                numbers = numbers && interp.values.back().kind == Kind::Number;
+            }
+            return numbers;
+        }
+
+        Cell apply(Interpreter& interp, size_t base) const {
+            List& values = interp.values;
+            Cell res = Parser::apply_prim(prim, {values.data() + base, values.data() + values.size()});
+            values.erase(values.begin() + base, values.end());
+            return res;
+        }
+
+        const Cell& prim;
+        vector<Argument> args;
+        const Cell* cells;      // the argument cells, where evlist goes on at a proc
+        const Steps* steps;     // evlist of the arguments
+        mutable atomic<State> state {Profiling};    // forms may run on several threads
+        mutable atomic<unsigned> seen {0};          // runs given only numbers while profiling
+    };
+
+    // the steps, each mirrors one case of Parser::evlist
+
+    class Then : public Step {      // the value of the eval node for the rest, then on at next
+    public:
+        Then(const Node* n, const Cell* nx) : node{n}, next{nx} {}
+        const Cell* run(Interpreter& interp, Env* env, size_t) const override {
+            interp.values.push_back(value(interp, node, env));
+            return next;
+        }
+    private:
+        const Node* node;
+        const Cell* next;
+    };
+
+    class Fail : public Step {
+    public:
+        Fail(const char* m) : msg{m} {}
+        const Cell* run(Interpreter&, Env*, size_t) const override { throw runtime_error(msg); }
+    private:
+        const char* msg;
+    };
+
+    class Walk_rest : public Step {
+    public:
+        Walk_rest(Span s) : span{s} {}
+        const Cell* run(Interpreter& interp, Env* env, size_t) const override {
+            Parser::evlist(interp, span, env);
+            return span.end();
+        }
+    private:
+        Span span;
+    };
+
+    class Include_rest : public Step {
+    public:
+        Include_rest(const string& f, const Cell* l) : file(f), last{l} {}
+        const Cell* run(Interpreter& interp, Env*, size_t start) const override {
+            List& values = interp.values;
+            interp.cs.include(file);
+            values.erase(values.begin() + start, values.end());
+            values.push_back({Kind::Include});
+            return last;
+        }
+    private:
+        const string& file;
+        const Cell* last;
+    };
+
+    class Name_rest : public Step {     // a variable's value, or a call taking the rest as arguments
+    public:
+        Name_rest(Ref r, Args a, const Cell* nx, const Cell* l) : ref(r), args(std::move(a)), next{nx}, last{l} {}
+        const Cell* run(Interpreter& interp, Env* env, size_t) const override {
+            const Cell& x = ref.get(env);
+            if (x.kind != Kind::Proc) {
+                interp.values.push_back(x);
+                return next;
+            }
+            Cell fn {x};
+            Roots roots {interp.heap};
+            roots.add(&fn);
+            size_t base = interp.values.size();
+            args.push(interp, env);
+            Cell res = call(interp, fn, base, nullptr);
+            interp.values.push_back(std::move(res));
+            return last;
+        }
+    private:
+        Ref ref;
+        Args args;
+        const Cell* next;
+        const Cell* last;
+    };
+
+    class Cond_rest : public Step {     // evlist goes on after the clause that matched
+    public:
+        struct Clause { const Node* test; const Node* body; const Cell* next; };
+        Cond_rest(vector<Clause> c, const Cell* l) : clauses(std::move(c)), last{l} {}
+        const Cell* run(Interpreter& interp, Env* env, size_t) const override {
+            for (size_t i = 0; i < clauses.size(); ++i) {
+                const Clause& c = clauses[i];
+                if (!c.test) {
+                    if (i + 1 != clauses.size()) throw runtime_error("Else clause not at end of condition");
+                    interp.values.push_back(value(interp, c.body, env));
+                    return last;
+                }
+                Cell t = value(interp, c.test, env);
+                if (t) {
+                    interp.values.push_back(value(interp, c.body, env));
+                    return c.next;
+                }
+            }
+            throw runtime_error("No cond clause matched");
+        }
+    private:
+        vector<Clause> clauses;
+        const Cell* last;
+    };
+
+    // one compiled top-level form, owning a copy of its syntax which every node refers into; procs
+    // made by its lambdas and defines share it through their code
+    class Unit : public enable_shared_from_this<Unit> {
+    public:
+        Unit(const List& form) : source(form) {}
+        shared_ptr<const Node> code(const Node* node) const { return {shared_from_this(), node}; }
+
+        List source;
+        vector<unique_ptr<Node>> nodes;
+        vector<unique_ptr<Step>> steps;
+        vector<unique_ptr<Steps>> lists;
+        vector<unique_ptr<Scope>> scopes;
+        vector<unique_ptr<List>> inlined;   // callee bodies with the arguments substituted
+        vector<unique_ptr<Cache>> caches;
+        vector<unique_ptr<Parallel::Evaluator>> forks;
+        map<tuple<const Cell*, const Cell*, const Scope*>, const Node*> compiled;
+        map<pair<const Cell*, const Scope*>, Steps*> evlists;   // by the end of the span
+    };
+
+    // the compiled arguments of a site Parallel may fork, found by their cell
+    class Fork_arguments : public Parallel::Evaluator {
+    public:
+        struct Value { const Cell* cell; const Node* node; };
+        struct Call { const Cell* cell; Args args; };
+        Cell value(Interpreter& interp, const Cell& expr, Env* env) const override {
+            for (auto& v : values) if (v.cell == &expr) return Compile::value(interp, v.node, env);
+            return Evaluator::value(interp, expr, env);
+        }
+        void arguments(Interpreter& interp, const Cell& call, Env* env) const override {
+            for (auto& c : calls) if (c.cell == &call) { c.args.push(interp, env); return; }
+            Evaluator::arguments(interp, call, env);
+        }
+        vector<Value> values;
+        vector<Call> calls;
+    };
+
+    Cell Lambda::eval(Interpreter& interp, Env* env, Tail*) const {
+        Proc* proc = Parser::closure(interp, params, body, env);
+        proc->code = unit.code(code);
+        return {proc};
+    }
+
+    Cell Define_proc::eval(Interpreter& interp, Env* env, Tail*) const {
+        Proc* proc = Parser::closure(interp, params, body, env);
+        proc->code = unit.code(code);
+        if (memo) Memo::attach(*proc, Memo::capacity(rest));
+        Cell c {proc};
+        (*env)[name] = c;
+        interp.heap.barrier(env);
+        return c;
+    }
+
+    bool is_string(const Cell& c) { return c.data.which() == 0; }
+    bool is_list(const Cell& c) { return c.data.which() == 3; }
+
+    bool primitive(Kind k) {
+        switch (k) {
+            case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal:
+            case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
+            case Kind::Empty:
+            case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+            case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max:
+                return true;
+            default: return false;
+        }
+    }
+
+    const Cell* find(Env* env, const string& name) {    // lookup without throwing
+        for (Env* e = env; e; e = e->parent())
+            if (const Cell* c = e->local(name)) return c;
+        return nullptr;
+    }
+
+    constexpr size_t max_inline_cells = 32;     // of a callee body
+    constexpr int max_inline_depth = 4;         // bodies inlined into bodies being inlined
+
+    // a body made only of primitives, cond, numbers, quotes and names, which binds nothing itself
+    // and never names self; its free names are collected, those heading a list in heads. A param
+    // never heads one: eval runs a span headed by a name other than one headed by a number
+    bool inlinable(const List& body, const string& self, const List& params, vector<string>& free, vector<string>& heads, size_t& cells) {
+        for (auto p = body.begin(); p != body.end(); ++p) {
+            if (++cells > max_inline_cells) return false;
+            switch (p->kind) {
+                case Kind::Number: case Kind::Cond: case Kind::Else: break;
+                case Kind::Quote:
+                    if (p + 1 == body.end()) return false;
+                    ++p;
+                    break;
+                case Kind::Expr:
+                    if (!inlinable(boost::get<List>(p->data), self, params, free, heads, cells)) return false;
+                    break;
+                case Kind::Name: {
+                    const string& name = boost::get<string>(p->data);
+                    if (name == self) return false;
+                    bool param = find_if(params.begin(), params.end(), [&](const Cell& c) { return boost::get<string>(c.data) == name; }) != params.end();
+                    if (p == body.begin()) {
+                        if (param) return false;
+                        heads.push_back(name);
+                    }
+                    if (!param && std::find(free.begin(), free.end(), name) == free.end()) free.push_back(name);
+                    break;
+                }
+                default: if (!primitive(p->kind)) return false;
+            }
+        }
+        return true;
+    }
+
+    // body with every unquoted param replaced by its argument, and names replaced by constants
+    List substitute(const List& body, const List& params, Span args, const map<string, Cell>& constants) {
+        List res;
+        for (auto p = body.begin(); p != body.end(); ++p) {
+            if (p->kind == Kind::Quote) {
+                res.push_back(*p);
+                res.push_back(*++p);
+                continue;
+            }
+            if (p->kind == Kind::Expr) {
+                res.push_back(substitute(boost::get<List>(p->data), params, args, constants));
+                continue;
+            }
+            if (p->kind == Kind::Name) {
+                const string& name = boost::get<string>(p->data);
+                size_t i = params.size();
+                while (i-- > 0 && boost::get<string>(params[i].data) != name);
+                if (i < params.size()) { res.push_back(args[i]); continue; }
+                auto c = constants.find(name);
+                if (c != constants.end()) { res.push_back(c->second); continue; }
+            }
+            res.push_back(*p);
+        }
+        return res;
+    }
+
+    class Compiler {
+    public:
+        Compiler(Unit& u, Env* e) : unit(u), env{e} {}
+
+        const Node* eval(Span s, const Scope* scope) {  // memoized, the same span often comes up again
+            auto key = make_tuple(s.begin(), s.end(), scope);
+            auto p = unit.compiled.find(key);
+            if (p != unit.compiled.end()) return p->second;
+            const Node* n = compile(s, scope);
+            unit.compiled[key] = n;
+            return n;
+        }
+
+        const Steps* evlist(Span s, const Scope* scope) {     // the steps from s.begin() on are compiled
+            Steps*& steps = unit.evlists[make_pair(s.end(), scope)];
+            if (!steps) {
+                unit.lists.emplace_back(new Steps{s.begin(), s.end()});
+                steps = unit.lists.back().get();
+            }
+            else if (s.begin() < steps->first) {    // a longer suffix of the same span
+                steps->at.insert(steps->at.begin(), steps->first - s.begin(), nullptr);
+                steps->first = s.begin();
+            }
+            fill(steps, s.begin(), scope);
+            return steps;
+        }
+
+    private:
+        template <typename T, typename... A>
+        const Node* node(A&&... a) {
+            unit.nodes.emplace_back(new T(std::forward<A>(a)...));
+            return unit.nodes.back().get();
+        }
+        template <typename T, typename... A>
+        const Step* step(A&&... a) {
+            unit.steps.emplace_back(new T(std::forward<A>(a)...));
+            return unit.steps.back().get();
+        }
+
+        Ref reference(const string& name, const Scope* scope) {   // globals get a cache of their own
+            Ref ref = resolve(name, scope);
+            if (ref.index < 0 && global(name, scope)) {
+                unit.caches.emplace_back(new Cache);
+                ref.cache = unit.caches.back().get();
+            }
+            return ref;
+        }
+
+        // the cells evlist can get to from "from", without recursing along the list
+        void fill(Steps* steps, const Cell* from, const Scope* scope) {
+            vector<const Cell*> todo {from};
+            while (!todo.empty()) {
+                const Cell* p = todo.back();
+                todo.pop_back();
+                if (p == steps->last || steps->at[p - steps->first]) continue;
+                const Step* s = compile(steps, p, scope, todo);
+                steps->at[p - steps->first] = s;
+            }
+        }
+
+        bool args(Span s, const Scope* scope, Args& args) {    // false where the tree walker would read past the end
+            if ((args.fork = forks({s.begin() + 1, s.end()}, scope))) {
+                args.first = s.begin() + 1;
+                args.last = s.end();
+            }
+            for (auto p = s.begin() + 1; p != s.end(); ++p) {
+                if (p->kind == Kind::Number) args.simple.push_back({p, {}});
+                else if (p->kind == Kind::Quote) {
+                    if (p + 1 == s.end()) return false;
+                    args.simple.push_back({++p, {}});
+                }
+                else if (p->kind == Kind::Name) args.simple.push_back({nullptr, reference(boost::get<string>(p->data), scope)});
+                else {
+                    args.steps = evlist({p, s.end()}, scope);
+                    args.rest = p;
+                    break;
+                }
+            }
+            return true;
+        }
+
+        const Parallel::Evaluator* forks(Span args, const Scope* scope) {   // null unless Parallel may fork args
+            if (!Parallel::threads || !Parallel::candidate(args)) return nullptr;
+            auto f = new Fork_arguments;
+            unit.forks.emplace_back(f);
+            for (auto p = args.begin(); p != args.end(); ++p) {
+                if (p->kind == Kind::Quote) ++p;
+                else if (p->kind == Kind::Expr) {
+                    f->values.push_back({p, eval(Span{*p}, scope)});
+                    const List& l = boost::get<List>(p->data);
+                    Args a;
+                    if (!l.empty() && l[0].kind == Kind::Name && this->args(l, scope, a)) f->calls.push_back({p, std::move(a)});
+                }
+            }
+            return f;
+        }
+
+        const Node* body(const List& params, const List& body, const Scope* enclosing) {  // of a lambda or define
+            unit.scopes.emplace_back(new Scope{nullptr, {}, !Parser::defines(body), true, !enclosing});
+            Scope* scope = unit.scopes.back().get();
+            bool captures = Parser::captures(body);
+            scope->slots = !captures || params.size() <= Env::fixed_slots;   // see Parser::enter
+            for (auto& p : params) {
+                if (!is_string(p)) scope->known = false;
+                else scope->names.push_back(&boost::get<string>(p.data));
+            }
+            return eval(body, scope);
+        }
+
+        const Node* compile(Span s, const Scope* scope) {
+            if (s.empty()) return node<Nothing>();
+            auto p = s.begin();
+            size_t n = s.size();
+            switch (p->kind) {
+                case Kind::Include:
+                    if (n < 2 || !is_string(p[1])) return node<Walk>(s);
+                    return node<Include>(boost::get<string>(p[1].data));
+                case Kind::Stats: return node<Stats>();
+                case Kind::Number: return node<Const>(*p);
+                case Kind::Quote:
+                    if (n == 1) return node<Throw>("Quote expects 1 arg");
+                    return node<Const>(p[1]);
+                case Kind::Begin: {
+                    if (n == 1) return node<Throw>("Begin expects at least one expression");
+                    return node<Begin>(evlist({p + 1, s.end() - 1}, scope), eval(Span{s.back()}, scope));
+                }
+                case Kind::Lambda: {
+                    if (n < 3) return node<Throw>("Malformed lambda expression");
+                    if (!is_list(p[1]) || !is_list(p[2])) return node<Walk>(s);
+                    const List& params = boost::get<List>(p[1].data);
+                    const List& b = boost::get<List>(p[2].data);
+                    return node<Lambda>(unit, params, b, body(params, b, scope));
+                }
+                case Kind::Define: case Kind::Memo: {
+                    if (n < 3) return node<Throw>("Malformed define expression");
+                    bool memo = p->kind == Kind::Memo;
+                    if (p[1].kind == Kind::Name && !memo) return node<Define>(boost::get<string>(p[1].data), eval({p + 2, s.end()}, scope));
+                    if (p[1].kind != Kind::Expr) return node<Throw>("Unfamiliar form to define");
+                    const List& declaration = boost::get<List>(p[1].data);
+                    if (declaration.empty() || !is_string(declaration[0]) || !is_list(p[2])) return node<Walk>(s);
+                    List params {declaration.begin() + 1, declaration.end()};
+                    const List& b = boost::get<List>(p[2].data);
+                    const Node* code = body(params, b, scope);
+                    return node<Define_proc>(unit, boost::get<string>(declaration[0].data), std::move(params), b, code, memo, Span{p + 3, s.end()});
+                }
+                case Kind::Memoize: {
+                    Args a;
+                    if (!args(s, scope, a)) return node<Walk>(s);
+                    return node<Memoize>(std::move(a));
+                }
+                case Kind::Expr: {
+                    const List& list = boost::get<List>(p->data);
+                    if (whole(list)) return eval(list, scope);  // no values to collapse
+                    if (!list.empty() && list[0].kind == Kind::Cond) {
+                        vector<Cond_expr::Clause> clauses;
+                        Span l {list};
+                        for (auto q = l.begin() + 1; q != l.end(); ++q) {
+                            if (!is_list(*q) || boost::get<List>(q->data).size() < 2) return node<Walk>(s);
+                            const List& clause = boost::get<List>(q->data);
+                            const Node* test = clause[0].kind == Kind::Else? nullptr : eval(Span{clause[0]}, scope);
+                            const Steps* rest = q + 1 == l.end()? nullptr : evlist({q + 1, l.end()}, scope);
+                            clauses.push_back({test, eval(Span{clause[1]}, scope), rest, q + 1});
+                        }
+                        return node<Cond_expr>(std::move(clauses));
+                    }
+                    Args a;
+                    bool head = !list.empty() && list[0].kind == Kind::Name;
+                    if (head && !args(list, scope, a)) return node<Walk>(s);
+                    Ref ref = head? reference(boost::get<string>(list[0].data), scope) : Ref{nullptr, 0, -1, nullptr};
+                    const Node* generic = node<Expr>(head, ref, std::move(a), evlist(list, scope), Span{list}.begin());
+                    return head? inline_call(list, scope, generic) : generic;
+                }
+                case Kind::Let: {
+                    if (n < 3) return node<Throw>("Let expects a list of definitions and a body");
+                    if (!is_list(p[1])) return node<Walk>(s);
+                    bool escapes = Parser::captures({p + 2, s.end()});
+                    bool defines = Parser::defines({p + 2, s.end()});
+                    unit.scopes.emplace_back(new Scope{scope, {}, !defines, !escapes, !scope});
+                    Scope* inner = unit.scopes.back().get();
+                    vector<Let::Binding> bindings;
+                    for (auto& pair : boost::get<List>(p[1].data)) {
+                        if (!is_list(pair)) return node<Walk>(s);
+                        const List& def = boost::get<List>(pair.data);
+                        if (def.size() < 2 || !is_string(def[0])) return node<Walk>(s);
+                        bindings.push_back({&boost::get<string>(def[0].data), eval(Span{def[1]}, scope)});
+                        inner->names.push_back(bindings.back().name);
+                    }
+                    const Node* b = p[2].kind == Kind::Expr? eval(boost::get<List>(p[2].data), inner) : eval(Span{p[2]}, inner);
+                    return node<Let>(std::move(bindings), escapes, defines, b);
+                }
+                case Kind::Cond: {
+                    vector<Cond::Clause> clauses;
+                    for (auto q = p + 1; q != s.end(); ++q) {
+                        if (!is_list(*q) || boost::get<List>(q->data).empty()) return node<Walk>(s);
+                        const List& clause = boost::get<List>(q->data);
+                        if (clause[0].kind == Kind::Else) {
+                            if (q + 1 == s.end() && clause.size() < 2) return node<Walk>(s);
+                            clauses.push_back({nullptr, q + 1 == s.end()? eval(Span{clause[1]}, scope) : nullptr});
+                        }
+                        else clauses.push_back({eval(Span{clause[0]}, scope), eval({Span{clause}.begin() + 1, Span{clause}.end()}, scope)});
+                    }
+                    return node<Cond>(std::move(clauses));
+                }
+                case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal:
+                case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
+                case Kind::Empty:
+                case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+                case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max: {
+                    if (n == 1) return node<Throw>("Primitives take at least one argument");
+                    const Parallel::Evaluator* fork = forks({p + 1, s.end()}, scope);
+                    const Node* generic = node<Primitive>(*p, evlist({p + 1, s.end()}, scope), p + 1, fork);
+                    if (fork) return generic;   // its calls cost more than the value stack
+                    if (Parser::accessor(*p) && n == 2 && p[1].kind == Kind::Name)
+                        return node<Access>(*p, reference(boost::get<string>(p[1].data), scope), generic);
+                    if (Arithmetic::applies(p->kind, n - 1) && all_of(p + 1, s.end(), [](const Cell& c) { return argument(c); })) {
+                        vector<Argument> a;
+                        for (auto q = p + 1; q != s.end(); ++q) a.push_back(argument(*q, scope));
+                        return node<Arithmetic>(*p, std::move(a), p + 1, evlist({p + 1, s.end()}, scope));
+                    }
+                    return generic;
+                }
+                case Kind::Name: {
+                    Args a;
+                    if (!args(s, scope, a)) return node<Walk>(s);
+                    return inline_call(s, scope, node<Variable>(reference(boost::get<string>(p->data), scope), std::move(a)));
+                }
+                default: return node<Throw>("Unmatched cell in eval");
+            }
+        }
+
+        // (name args...) where name holds a small proc defined in the form's env, and every argument
+        // is a number or a variable no define can change, so it reads the same wherever the body
+        // uses it; names the body looks up in sealed frames of the proc's env become their numbers
+        const Node* inline_call(Span call, const Scope* scope, const Node* generic) {
+            if (!env || depth == max_inline_depth) return generic;
+            const string& name = boost::get<string>(call[0].data);
+            if (!global(name, scope)) return generic;
+            const Cell* c = find(env, name);
+            if (!c || c->kind != Kind::Proc) return generic;
+            const Proc* proc = boost::get<Proc*>(c->data);
+            if (proc->memo) return generic;     // its calls are answered from the cache
+            const List& params = proc->params;
+            if (params.size() != call.size() - 1) return generic;
+            for (auto p = params.begin(); p != params.end(); ++p)
+                if (p->kind != Kind::Name || find_if(params.begin(), p, [&](const Cell& q) { return boost::get<string>(q.data) == boost::get<string>(p->data); }) != p)
+                    return generic;
+            for (auto p = call.begin() + 1; p != call.end(); ++p)
+                if (p->kind != Kind::Number && (p->kind != Kind::Name || !local(boost::get<string>(p->data), scope))) return generic;
+            vector<string> free, heads;
+            size_t cells = 0;
+            if (!inlinable(proc->body, name, params, free, heads, cells)) return generic;
+            map<string, Cell> constants;
+            for (auto& n : free) {
+                Env* e = proc->env;
+                for (; e && e != env; e = e->parent()) {
+                    if (!e->is_sealed()) return generic;
+                    if (const Cell* v = e->local(n)) {
+                        if (v->kind != Kind::Number || std::find(heads.begin(), heads.end(), n) != heads.end()) return generic;
+                        constants[n] = *v;
+                        break;
+                    }
+                }
+                if (!e) return generic;
+                if (e == env && !global(n, scope)) return generic;
+            }
+            unit.inlined.emplace_back(new List(substitute(proc->body, params, {call.begin() + 1, call.end()}, constants)));
+            List& body = *unit.inlined.back();
+            Optimize::form(body);
+            ++depth;
+            const Node* code = eval(body, scope);
+            --depth;
+            inlined.fetch_add(1, memory_order_relaxed);
+            return node<Inline>(reference(name, scope), proc->serial, code, generic);
+        }
+
+        // evlist of the list leaves just what eval of it gives
+        static bool whole(const List& list) {
+            if (list.empty()) return false;
+            switch (list[0].kind) {
+                case Kind::Number: case Kind::Stats: return list.size() == 1;
+                case Kind::Quote: return list.size() == 2;
+                case Kind::Lambda: return list.size() == 3;
+                case Kind::Include: case Kind::Begin: case Kind::Define: case Kind::Memo: case Kind::Let: case Kind::Memoize:
+                case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal:
+                case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
+                case Kind::Empty:
+                case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+                case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max:
+                    return true;
+                default: return false;
+            }
+        }
+
+        static bool argument(const Cell& c) { return c.kind == Kind::Number || c.kind == Kind::Name || c.kind == Kind::Expr; }
+        Argument argument(const Cell& c, const Scope* scope) {
+            if (c.kind == Kind::Number) return {{&c, {}}, nullptr};
+            if (c.kind == Kind::Name) return {{nullptr, reference(boost::get<string>(c.data), scope)}, nullptr};
+            return {{nullptr, {}}, eval(Span{c}, scope)};
+        }
+
+        // the step at p, adding the cells evlist may go on at to todo
+        const Step* compile(Steps* steps, const Cell* p, const Scope* scope, vector<const Cell*>& todo) {
+            const Cell* last = steps->last;
+            Span rest {p, last};
+            switch (p->kind) {
+                case Kind::Include:
+                    if (p + 1 == last || !is_string(p[1])) return step<Walk_rest>(rest);
+                    return step<Include_rest>(boost::get<string>(p[1].data), last);
+                case Kind::Stats: case Kind::Number:
+                    todo.push_back(p + 1);
+                    return step<Then>(eval(rest, scope), p + 1);
+                case Kind::Quote: {
+                    const Cell* next = p + 1 == last? last : p + 2;
+                    todo.push_back(next);
+                    return step<Then>(eval(rest, scope), next);
+                }
+                case Kind::Lambda: {
+                    const Cell* next = last - p < 3? last : p + 3;
+                    todo.push_back(next);
+                    return step<Then>(eval(rest, scope), next);
+                }
+                case Kind::Expr:
+                    todo.push_back(p + 1);
+                    return step<Then>(eval(Span{*p}, scope), p + 1);
+                case Kind::Begin: case Kind::Define: case Kind::Memo: case Kind::Let: case Kind::Memoize:
+                case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal:
+                case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
+                case Kind::Empty:
+                case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+                case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max:
+                    return step<Then>(eval(rest, scope), last);
+                case Kind::Cond: {
+                    vector<Cond_rest::Clause> clauses;
+                    for (auto q = p + 1; q != last; ++q) {
+                        if (!is_list(*q)) return step<Walk_rest>(rest);
+                        const List& clause = boost::get<List>(q->data);
+                        if (clause.empty()) return step<Walk_rest>(rest);
+                        if (clause[0].kind == Kind::Else) {
+                            if (q + 1 == last && clause.size() < 2) return step<Walk_rest>(rest);
+                            clauses.push_back({nullptr, q + 1 == last? eval(Span{clause[1]}, scope) : nullptr, last});
+                        }
+                        else {
+                            if (clause.size() < 2) return step<Walk_rest>(rest);
+                            clauses.push_back({eval(Span{clause[0]}, scope), eval(Span{clause[1]}, scope), q + 1});
+                            todo.push_back(q + 1);
+                        }
+                    }
+                    return step<Cond_rest>(std::move(clauses), last);
+                }
+                case Kind::Name: {
+                    Args a;
+                    if (!args(rest, scope, a)) return step<Walk_rest>(rest);
+                    todo.push_back(p + 1);
+                    return step<Name_rest>(reference(boost::get<string>(p->data), scope), std::move(a), p + 1, last);
+                }
+                default: return step<Fail>("Unmatched in evlist");
+            }
+        }
+
+        Unit& unit;
+        Env* env;       // the form runs in, for the procs its calls may inline
+        int depth {0};  // bodies being inlined
+    };
+}
+
+Cell run_form(Interpreter& interp, const List& form, Env* env) {
+    auto unit = make_shared<Unit>(form);    // copied out of the arena, procs made by the form may keep it
+    const Node* root = Compiler{*unit, env}.eval(unit->source, nullptr);
+    return run(interp, root, env);
+}
+
+Cell call(Interpreter& interp, const Cell& fn, size_t args) {
+    const Proc* proc = boost::get<Proc*>(fn.data);
+    if (!proc->code) return Parser::call(interp, fn, args);     // made by the tree walker
+    Cell res;
+    if (Memo::run(interp, fn, args, res) || Jit::run(interp, fn, args, res)) return res;
+    Frame_mark mark {interp.stack};
+    Env* frame = Parser::enter(interp, fn, args);
+    return run(interp, proc->code.get(), frame);
+}
+
+Cell body(Interpreter& interp, const Proc& proc, Env* frame) {
+    return run(interp, proc.code.get(), frame);
+}
+}
@@ -0,0 +1,28 @@
+#ifndef clispp_compile
+#define clispp_compile
+#include <atomic>
+#include <memory>
+#include "parser_impl.h"
+
+// closure compilation: each top-level form is translated once into a tree of nodes that know what
+// every cell is, which primitive they apply and which frame slot a variable lives in, then the
+// tree is run; a proc made while running keeps the compiled tree of its body for every call.
+// Calls to small procs already defined at the top level are compiled into their bodies, guarded
+// by the proc the name holds, and go back to calling it once the name is redefined. Names found in
+// the form's env are cached at each site until the next define into it, and arithmetic sites
+// only ever given numbers stop going through the value stack
+namespace Compile {
+    using namespace Lexer;
+    using namespace Environment;
+
+    extern std::atomic<size_t> inlined;     // call sites compiled into the callee's body, shown by (stats)
+    extern std::atomic<size_t> deopts;      // of those, sites that found their name redefined
+    extern std::atomic<size_t> misses;      // global lookups not found in their site's cache
+    extern std::atomic<size_t> specialized;     // arithmetic sites reading their numbers directly
+    extern std::atomic<size_t> despecialized;   // of those, sites given something else since
+
+    Cell run_form(Interpreter& interp, const List& form, Env* env);    // compiles form and evaluates it in env
+    Cell call(Interpreter& interp, const Cell& proc, size_t args);      // args are interp.values from index args on
+    Cell body(Interpreter& interp, const Proc& proc, Env* frame);      // proc's compiled body, in a frame from Parser::enter
+}
+#endif
@@ -1,7 +1,10 @@
 #ifndef clispp_environment
 #define clispp_environment
 #include <memory>
+#include <new>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include "forward.h"
 #include "lexer.h"
 #include "error.h"
@@ -13,10 +16,25 @@ namespace Environment {
     using Lexer::List;
 
     class Env {
+        friend class Heap;  // traces bindings and outer
+    public:
+        static constexpr size_t fixed_slots = 4;
     private:
         using Env_map = unordered_map<string, Cell>;
-        Env_map env;
+        using Slot = pair<const string*, Cell>;    // named by the param or let syntax it came from
+        unique_ptr<Env_map> env;    // general frames only: the global, lets that escape, procs that define or take many params
+        alignas(Slot) unsigned char storage[fixed_slots * sizeof(Slot)];  // most calls bind a few params, without allocating
+        vector<Slot> slots;         // bindings past the fixed slots
+        Proc* owner {nullptr};      // keeps the param names of a heap frame's slots alive
         Env* outer;
+        size_t defines {0};         // bumped by each define, so a binding cached from the frame is known stale
+        unsigned char used {0};     // inline slots bound
+        bool frozen {false};    // shared read only between forks, see Interpreter
+        bool sealed {false};    // never defined into again, so closures may copy its bindings
+
+        Slot* inline_slots() { return reinterpret_cast<Slot*>(storage); }
+        const Slot* inline_slots() const { return reinterpret_cast<const Slot*>(storage); }
+        void clear() { while (used) inline_slots()[--used].~Slot(); }
     public:
         // constructors
         Env() : outer{nullptr} {}
@@ -24,37 +42,58 @@ namespace Environment {
         Env(const List& params, const List& args, Env* o) : outer{o} {
             auto a = args.begin();
             for (auto p = params.begin(); p != params.end(); ++p, ++a)
-                env[boost::get<string>(p->data)] = *a++;    
+                (*this)[boost::get<string>(p->data)] = *a++;    
         }
 
-        Env_map& findframe(string n) {
-            if (env.find(n) != env.end())
-                return env;
-            else if (outer != nullptr) 
-                return outer->findframe(n);
+        Cell& lookup(const string& n) {   // find only, frozen frames are read concurrently
+            for (Env* e = this; e; e = e->outer)
+                if (const Cell* c = e->local(n)) return const_cast<Cell&>(*c);
             throw runtime_error("Unbound variable");
         }
 
-        Cell& lookup(string n) {
-            return findframe(n)[n];
+        const Cell* local(const string& n) const {  // this frame only, nullptr if unbound here
+            for (auto s = slots.rbegin(); s != slots.rend(); ++s) if (*s->first == n) return &s->second;   // the last binding wins
+            for (size_t i = used; i-- > 0;) if (*inline_slots()[i].first == n) return &inline_slots()[i].second;
+            if (!env) return nullptr;
+            auto p = env->find(n);
+            return p == env->end()? nullptr : &p->second;
+        }
+        Env* parent() const { return outer; }
+        const Cell& slot(size_t i) const {  // i-th binding of a frame bound by bind, in binding order
+            return i < fixed_slots? inline_slots()[i].second : slots[i - fixed_slots].second;
         }
 
-        Cell& operator[](string n) { // access for assignment
-            return env[n];
+        Cell& operator[](const string& n) { // access for assignment
+            if (frozen) throw runtime_error("Cannot define in a frozen environment");
+            if (!env) env.reset(new Env_map);
+            ++defines;
+            return (*env)[n];
         }
 
-        // copying and moving
-        Env(const Env&) = default;
-        Env& operator=(const Env&) = default;
+        void bind(const string& n, Cell&& value) {  // n outlives the frame
+            if (used < fixed_slots) new (inline_slots() + used++) Slot{&n, std::move(value)};
+            else slots.emplace_back(&n, std::move(value));
+        }
+        void bind(Proc* proc, const string& n, Cell&& value) { owner = proc; bind(n, std::move(value)); }  // n is one of proc's params
+        void reset(Env* o) {    // reuse for another call, keeps the capacity
+            env.reset();
+            clear();
+            slots.clear();
+            outer = o;
+            sealed = false;
+            ++defines;
+        }
+        void seal() { sealed = true; }
+        bool is_sealed() const { return sealed; }
+        void freeze() { frozen = true; }
+        bool is_frozen() const { return frozen; }
+        size_t epoch() const { return defines; }    // the same while the frame's bindings stay where they are
 
-        Env(Env&&) = default;
-        Env& operator=(Env&&) = default;
-        ~Env() = default;
-    };
+        // frames are shared by pointer, never copied or moved
+        Env(const Env&) = delete;
+        Env& operator=(const Env&) = delete;
 
-    extern Env e0;
-    constexpr int max_capacity = 10000; // max of 10000 variables and procedures
-    extern vector<Env> envs; 
-    extern vector<Proc> procs;
+        ~Env() { clear(); }
+    };
 }
 #endif
@@ -1,11 +1,26 @@
 #ifndef clispp_forward
 #define clispp_forward
 #include <vector>
+#include "arena.h"
 namespace Lexer {
     struct Cell;
-    using List = std::vector<Cell>;
+    using List = std::vector<Cell, Arena_allocator<Cell>>;  // parse trees live in an arena, copies on the free store
 }
 namespace Environment {
     class Env;
+    class Heap;
+    class Interpreter;
+}
+namespace Compile {
+    class Node;
+}
+namespace Jit {
+    struct Code;
+}
+namespace Memo {
+    class Cache;
+}
+namespace Parallel {
+    struct Profile;
 }
 #endif
@@ -0,0 +1,200 @@
+#include "heap.h"
+
+using namespace Environment;
+
+Heap::Clock::duration Heap::default_pause {chrono::milliseconds{1}};
+
+namespace {
+    atomic<size_t> serials {0};     // shared by every interpreter, compiled code may run in a fork
+}
+
+Env* Heap::make_env(Env* outer) {
+    maybe_collect();    // before constructing, so the new frame never has to be a root
+    ++young;
+    Env* env = envs.make(outer);
+    if (phase == Phase::Marking) mark(env);     // gray, scanned once bind has filled it
+    return env;
+}
+
+Proc* Heap::make_proc(const List& params, const List& body, Env* env, bool captures, bool defines) {
+    maybe_collect();
+    ++young;
+    Proc* proc = procs.make(params, body, env, captures, defines);
+    proc->serial = serials.fetch_add(1, memory_order_relaxed) + 1;
+    if (phase == Phase::Marking) mark(proc);
+    return proc;
+}
+
+void Heap::barrier(Env* env) {
+    if (phase == Phase::Marking && envs.owns(env)) gray_envs.push_back(env);    // rescan, it may hold white objects now
+    if (env == global) global_dirty = true;
+    // until a major sweep has passed, young frames marked during it are about to become old
+    else if (envs.owns(env) && (phase != Phase::Idle || Space<Env>::is_old(env)) 
+            && (remembered.empty() || remembered.back() != env))
+        remembered.push_back(env);
+}
+
+void Heap::maybe_collect() {
+    if (phase != Phase::Idle) {
+        if (++since_step >= step_size) step();
+        if (young >= 4 * nursery_size) collect(true);  // allocation outran the steps
+    }
+    else if (young >= nursery_size) collect_young();
+}
+
+void Heap::collect_young() {    // a minor collection, or a major one once the old space outgrew its limit
+    if (envs.old + procs.old <= old_limit) collect(false);
+    else if (incremental) {
+        auto start = Clock::now();
+        begin_major();
+        record(Clock::now() - start);
+    }
+    else collect(true);
+}
+
+void Heap::collect(bool full) {
+    auto start = Clock::now();
+    if (phase == Phase::Idle && !full) {
+        major = false;
+        mark_roots();
+        drain();
+        auto e = envs.sweep_young();
+        auto p = procs.sweep_young();
+        remembered.clear();
+        global_dirty = false;
+        young = 0;
+        ++stats.minor;
+        stats.freed += e.first + p.first;
+        stats.promoted += e.second + p.second;
+    }
+    else {
+        if (phase == Phase::Idle) begin_major();
+        if (phase == Phase::Marking) {
+            drain();
+            finish_marking();
+        }
+        while (!envs.sweep_step() || !procs.sweep_step());
+        finish_sweeping();
+    }
+    record(Clock::now() - start);
+}
+
+// everything a top-level form allocated is young, so a minor collection rooted at e0 and its
+// result releases the rest in bulk, recycling whole blocks when nothing survived
+void Heap::end_region(const Cell& result) {
+    if (young == 0 || phase != Phase::Idle) return;     // a major collection in progress gets there anyway
+    Roots roots {*this};
+    roots.add(&result);
+    collect_young();    // results promoted here add up, so the old space limit still applies
+}
+
+void Heap::step() {     // one bounded slice of the major collection in progress
+    auto start = Clock::now();
+    auto deadline = start + pause_target;
+    since_step = 0;
+    if (phase == Phase::Marking && drain(deadline)) finish_marking();
+    else if (phase == Phase::Sweeping) {
+        bool done;
+        do done = envs.sweep_step() && procs.sweep_step();
+        while (!done && Clock::now() < deadline);
+        if (done) finish_sweeping();
+    }
+    ++stats.steps;
+    record(Clock::now() - start);
+}
+
+void Heap::begin_major() {
+    major = true;
+    phase = Phase::Marking;
+    since_step = 0;
+    mark_roots();
+}
+
+// the roots changed while marking, so gray them again and finish marking at once
+void Heap::finish_marking() {
+    mark_roots();
+    drain();
+    remembered.clear();     // everything reachable is marked and becomes old
+    global_dirty = false;
+    envs.begin_sweep();
+    procs.begin_sweep();
+    young = 0;
+    phase = Phase::Sweeping;
+}
+
+void Heap::finish_sweeping() {
+    ++stats.major;
+    stats.freed += envs.swept.first + procs.swept.first;
+    stats.promoted += envs.swept.second + procs.swept.second;
+    old_limit = max(old_limit, 2 * (envs.old + procs.old));
+    phase = Phase::Idle;
+}
+
+void Heap::mark_roots() {
+    for (auto env : frames) {
+        if (env == global) continue;
+        if (envs.owns(env)) mark(env);
+        else scan(env);     // a frame of the frame stack
+    }
+    if (major || global_dirty) scan(global);
+    if (!major) for (auto env : remembered) scan(env);
+    for (auto cell : cells) mark(*cell);
+    for (auto list : lists) for (auto& cell : *list) mark(cell);
+}
+
+void Heap::freeze() {
+    collect(true);      // no collection may be left half done once forks share the frames
+    envs.each([](Env* env) { env->freeze(); });
+}
+
+void Heap::mark(Env* env) {
+    if (envs.owns(env) && Space<Env>::mark(env, major)) gray_envs.push_back(env);
+}
+
+void Heap::mark(Proc* proc) {
+    if (procs.owns(proc) && Space<Proc>::mark(proc, major)) gray_procs.push_back(proc);
+}
+
+void Heap::mark(const Cell& cell) {
+    if (auto proc = boost::get<Proc*>(&cell.data)) mark(*proc);
+    else if (auto list = boost::get<List>(&cell.data))
+        for (auto& c : *list) mark(c);
+}
+
+void Heap::scan(Env* env) {
+    if (env->env) for (auto& binding : *env->env) mark(binding.second);
+    for (size_t i = 0; i < env->used; ++i) mark(env->inline_slots()[i].second);
+    for (auto& slot : env->slots) mark(slot.second);
+    if (env->owner) mark(env->owner);
+    if (!env->outer || env->outer == global) return;    // the global is traced on its own
+    if (env->outer->is_frozen()) return;    // reaches only the frozen heap, which mark passes over
+    if (envs.owns(env->outer)) mark(env->outer);
+    // otherwise a frame of another heap, which this thread must not read, or of the frame stack,
+    // which whatever still reads it holds as a root
+}
+
+bool Heap::drain(Clock::time_point deadline) {
+    for (size_t n = 1; !gray_envs.empty() || !gray_procs.empty(); ++n) {
+        if (n % 64 == 0 && Clock::now() >= deadline) return false;
+        if (!gray_envs.empty()) {
+            Env* env = gray_envs.back();
+            gray_envs.pop_back();
+            scan(env);
+        }
+        else {
+            Proc* proc = gray_procs.back();
+            gray_procs.pop_back();
+            mark(proc->env);    // params and body are syntax, never heap objects
+        }
+    }
+    return true;
+}
+
+void Heap::record(Clock::duration pause) {
+    auto us = chrono::duration_cast<chrono::microseconds>(pause).count();
+    size_t i = 0;
+    for (long bound = 4; i + 1 < buckets && us >= bound; bound *= 4) ++i;
+    ++stats.pauses[i];
+    stats.total_pause += pause;
+    stats.max_pause = max(stats.max_pause, pause);
+}
@@ -0,0 +1,299 @@
+#ifndef clispp_heap
+#define clispp_heap
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include "forward.h"
+#include "lexer.h"
+#include "environment.h"
+
+namespace Environment {
+    using namespace std;
+
+    // same sized objects in blocks aligned to their size, so any object pointer finds its block;
+    // new objects are bumped into the free slots of nursery blocks and promoted in place
+    template <typename T>
+    class Space {
+    public:
+        static constexpr size_t block_size = 1 << 16;
+        enum class State : unsigned char { Free, Young, Old };
+        struct Block {
+            static constexpr size_t capacity = (block_size - 64) / (sizeof(T) + 2);
+            size_t cursor {0};      // bump allocation skips slots still in use
+            size_t live {0};
+            State state[capacity];
+            bool marked[capacity];
+            alignas(T) unsigned char storage[capacity * sizeof(T)];
+
+            Block() { for (size_t i = 0; i < capacity; ++i) { state[i] = State::Free; marked[i] = false; } }
+            T* slot(size_t i) { return reinterpret_cast<T*>(storage) + i; }
+            size_t index(const T* p) { return p - slot(0); }
+        };
+        static_assert(sizeof(Block) <= block_size, "block header too large");
+
+        Space() {}
+        ~Space() {
+            for (auto b : all) release(b);
+            for (auto b : pending) release(b);
+            for (auto b : spare) free(b);
+        }
+
+        template <typename... Args>
+        T* make(Args&&... args) {   // always young
+            while (!current || current->cursor == Block::capacity) next();
+            while (current->state[current->cursor] != State::Free)
+                if (++current->cursor == Block::capacity) next();
+            size_t i = current->cursor++;
+            T* p = new (current->slot(i)) T{std::forward<Args>(args)...};
+            current->state[i] = State::Young;
+            ++current->live;
+            ++young;
+            return p;
+        }
+
+        bool owns(const void* p) const { return blocks.count(block_of(p)); }
+        static bool is_old(const T* p) { Block* b = block_of(p); return b->state[b->index(p)] == State::Old; }
+        // true if p was not marked yet, a minor collection only marks young objects
+        static bool mark(T* p, bool major) {
+            Block* b = block_of(p);
+            size_t i = b->index(p);
+            if (b->marked[i] || (!major && b->state[i] == State::Old)) return false;
+            return b->marked[i] = true;
+        }
+
+        // frees unmarked young objects and promotes marked ones, visiting only the nursery blocks
+        pair<size_t, size_t> sweep_young() {
+            swept = {0, 0};
+            for (auto b : nursery) sweep(b, false);
+            vector<Block*> keep;    // empty blocks go back to the pool, half empty ones become nursery again
+            holes.clear();
+            for (auto b : all) if (settle(b)) keep.push_back(b);
+            all.swap(keep);
+            nursery.clear();
+            current = nullptr;
+            old = old + young - swept.first;
+            young = 0;
+            return swept;
+        }
+
+        // a major sweep visits every block a few at a time, new objects meanwhile go to swept blocks
+        void begin_sweep() {
+            pending.swap(all);
+            all.clear();
+            nursery.clear();
+            holes.clear();
+            current = nullptr;
+            swept = {0, 0};
+            unswept = young;
+            young = 0;
+        }
+        bool sweep_step() {     // true once every block is swept
+            if (pending.empty()) return true;
+            Block* b = pending.back();
+            pending.pop_back();
+            sweep(b, true);
+            if (settle(b)) all.push_back(b);
+            if (!pending.empty()) return false;
+            old = old + unswept - swept.first;
+            return true;
+        }
+        pair<size_t, size_t> swept {0, 0};     // {freed, promoted} by the last sweep
+
+        template <typename F>
+        void each(F f) {
+            for (auto b : all)
+                for (size_t i = 0; i < Block::capacity; ++i)
+                    if (b->state[i] != State::Free) f(b->slot(i));
+            for (auto b : pending)
+                for (size_t i = 0; i < Block::capacity; ++i)
+                    if (b->state[i] != State::Free) f(b->slot(i));
+        }
+
+        size_t young {0};   // objects made since the last collection
+        size_t old {0};     // promoted objects still live
+
+        Space(const Space&) = delete;
+        Space& operator=(const Space&) = delete;
+    private:
+        static Block* block_of(const void* p) {
+            return reinterpret_cast<Block*>(reinterpret_cast<uintptr_t>(p) & ~(block_size - 1));
+        }
+
+        void sweep(Block* b, bool major) {
+            for (size_t i = 0; i < Block::capacity; ++i) {
+                if (b->state[i] == State::Free || (!major && b->state[i] == State::Old)) continue;
+                if (b->marked[i]) {
+                    if (b->state[i] == State::Young) { b->state[i] = State::Old; ++swept.second; }
+                    b->marked[i] = false;
+                }
+                else {
+                    b->slot(i)->~T();
+                    b->state[i] = State::Free;
+                    --b->live;
+                    ++swept.first;
+                }
+            }
+        }
+
+        bool settle(Block* b) {     // false if b went back to the pool
+            if (b->live == 0) { recycle(b); return false; }
+            if (b->live < Block::capacity / 2) holes.push_back(b);
+            return true;
+        }
+
+        void next() {   // reuse a block with holes before taking a fresh one
+            if (!holes.empty()) { current = holes.back(); holes.pop_back(); }
+            else {
+                void* mem;
+                if (!spare.empty()) { mem = spare.back(); spare.pop_back(); }
+                else if (!(mem = aligned_alloc(block_size, block_size))) throw bad_alloc();
+                blocks.insert(mem);
+                current = new (mem) Block;
+                all.push_back(current);
+            }
+            current->cursor = 0;
+            nursery.push_back(current);
+        }
+
+        void recycle(Block* b) {
+            blocks.erase(b);
+            b->~Block();
+            if (spare.size() < 16) spare.push_back(b);  // keep a few for the next nursery
+            else free(b);
+        }
+
+        void release(Block* b) {
+            for (size_t i = 0; i < Block::capacity; ++i)
+                if (b->state[i] != State::Free) b->slot(i)->~T();
+            blocks.erase(b);
+            free(b);
+        }
+
+        Block* current {nullptr};   // bump allocation block
+        vector<Block*> all;
+        vector<Block*> nursery;     // blocks young objects were made in since the last collection
+        vector<Block*> holes;       // blocks at most half full, reused as nursery blocks
+        vector<Block*> pending;     // blocks a major sweep has yet to visit
+        size_t unswept {0};         // young objects when the major sweep began
+        vector<void*> spare;
+        unordered_set<const void*> blocks;
+    };
+
+    // generational collector for frames and procs: minor collections trace only young objects
+    // reachable from the roots and the remembered old frames, then promote the survivors in place;
+    // major collections mark and sweep in steps of at most pause_target, driven by allocation
+    class Heap {
+    public:
+        using Clock = chrono::steady_clock;
+
+        Heap(Env* g) : global{g} {}
+
+        Env* make_env(Env* outer);
+        Proc* make_proc(const List& params, const List& body, Env* env, bool captures, bool defines);
+        void barrier(Env* env);     // after defining into env, so old frames pointing at young objects are traced
+        void collect(bool major);   // stop the world, finishing any major collection in progress
+        void end_region(const Cell& result);    // after each top-level form, frees what only it used
+        void freeze();              // makes every frame read only
+
+        // roots, everything evaluations in progress hold on the C++ stack (see Roots)
+        vector<Env*> frames;
+        vector<const Cell*> cells;
+        vector<const List*> lists;
+
+        size_t nursery_size {8192};     // young objects allocated between minor collections
+        bool incremental {true};        // major collections in steps rather than all at once
+        Clock::duration pause_target {default_pause};
+        size_t step_size {256};         // allocations between incremental steps
+        static Clock::duration default_pause;
+
+        static constexpr size_t buckets = 8;    // pause histogram, bucket i holds pauses under 4^(i+1) us
+        struct Stats {
+            size_t minor, major, steps, freed, promoted;
+            Clock::duration total_pause, max_pause;
+            size_t pauses[buckets];
+        } stats {};
+
+        Heap(const Heap&) = delete;
+        Heap& operator=(const Heap&) = delete;
+    private:
+        enum class Phase { Idle, Marking, Sweeping };
+
+        void maybe_collect();
+        void collect_young();
+        void step();
+        void begin_major();
+        void finish_marking();
+        void finish_sweeping();
+        void mark_roots();
+        void mark(Env* env);
+        void mark(Proc* proc);
+        void mark(const Cell& cell);
+        void scan(Env* env);
+        bool drain(Clock::time_point deadline = Clock::time_point::max());  // true once nothing is gray
+        void record(Clock::duration pause);
+
+        Env* global;                // interpreter's e0, an old root only traced by minor collections when dirty
+        bool global_dirty {false};
+        Space<Env> envs;
+        Space<Proc> procs;
+        vector<Env*> remembered;    // old frames defined into since the last collection
+        vector<Env*> gray_envs;
+        vector<Proc*> gray_procs;
+        size_t young {0};
+        size_t old_limit {1 << 16}; // old objects before a major collection, doubles with the live size
+        bool major {false};
+        Phase phase {Phase::Idle};
+        size_t since_step {0};
+    };
+
+    // frames of calls nothing can capture, reused in LIFO order instead of collected
+    class Frame_stack {
+    public:
+        Env* push(Env* outer) {
+            if (top == frames.size()) frames.emplace_back(new Env{outer});
+            else frames[top]->reset(outer);
+            return frames[top++].get();
+        }
+        size_t depth() const { return top; }
+        void unwind(size_t d) { top = d; }
+    private:
+        vector<unique_ptr<Env>> frames;     // never moves an Env, evaluation holds pointers to them
+        size_t top {0};
+    };
+
+    // pops the frames pushed for the rest of the scope
+    class Frame_mark {
+    public:
+        Frame_mark(Frame_stack& s) : stack(s), depth{s.depth()} {}
+        ~Frame_mark() { stack.unwind(depth); }
+
+        Frame_mark(const Frame_mark&) = delete;
+        Frame_mark& operator=(const Frame_mark&) = delete;
+    private:
+        Frame_stack& stack;
+        size_t depth;
+    };
+
+    // registers the locals of one evaluation as roots for the rest of its scope
+    class Roots {
+    public:
+        Roots(Heap& h) : heap(h), frames{h.frames.size()}, cells{h.cells.size()}, lists{h.lists.size()} {}
+        ~Roots() { clear(); }
+        void add(Env* env) { heap.frames.push_back(env); }
+        void add(const Cell* cell) { heap.cells.push_back(cell); }
+        void add(const List* list) { heap.lists.push_back(list); }
+        void clear() { heap.frames.resize(frames); heap.cells.resize(cells); heap.lists.resize(lists); }   // drops what was added
+
+        Roots(const Roots&) = delete;
+        Roots& operator=(const Roots&) = delete;
+    private:
+        Heap& heap;
+        size_t frames, cells, lists;
+    };
+}
+#endif
@@ -0,0 +1,56 @@
+#include "interpreter.h"
+#include "jit.h"
+#include "compile.h"
+#include "optimize.h"
+#include "memo.h"
+#include "parallel.h"
+
+using namespace Environment;
+
+Interpreter::Mode Interpreter::default_mode {Interpreter::Mode::Walk};
+
+Interpreter::Interpreter(istream& in, ostream& out) : cs{in}, outstream{&out} {
+    values.reserve(256);
+    heap.lists.push_back(&values);
+}
+
+Interpreter::Interpreter(shared_ptr<Interpreter> b, istream& in, ostream& out) 
+    : cs{in}, outstream{&out}, base{b}, e0{&b->e0} {
+    if (!base->e0.is_frozen()) throw runtime_error("Can only fork a frozen interpreter");
+    values.reserve(256);
+    heap.lists.push_back(&values);
+}
+
+void Interpreter::freeze() {
+    e0.freeze();
+    heap.freeze();
+}
+
+List Interpreter::stats() const {
+    auto us = [](Heap::Clock::duration d) { return chrono::duration<double, micro>(d).count(); };
+    const Heap::Stats& s = heap.stats;
+    List res {List{"minor", double(s.minor)}, List{"major", double(s.major)}, List{"steps", double(s.steps)},
+        List{"freed", double(s.freed)}, List{"promoted", double(s.promoted)},
+        List{"list-copies", double(Lexer::list_copies.load(memory_order_relaxed))},
+        List{"jit-procs", double(Jit::compiled.load(memory_order_relaxed))},
+        List{"folds", double(Optimize::folds.load(memory_order_relaxed))},
+        List{"cond-pruned", double(Optimize::pruned.load(memory_order_relaxed))},
+        List{"identities", double(Optimize::identities.load(memory_order_relaxed))},
+        List{"accumulated", double(Optimize::accumulated.load(memory_order_relaxed))},
+        List{"inlined", double(Compile::inlined.load(memory_order_relaxed))},
+        List{"deopts", double(Compile::deopts.load(memory_order_relaxed))},
+        List{"global-misses", double(Compile::misses.load(memory_order_relaxed))},
+        List{"specialized", double(Compile::specialized.load(memory_order_relaxed))},
+        List{"despecialized", double(Compile::despecialized.load(memory_order_relaxed))},
+        List{"memo-hits", double(Memo::hits.load(memory_order_relaxed))},
+        List{"memo-misses", double(Memo::misses.load(memory_order_relaxed))},
+        List{"memo-evictions", double(Memo::evictions.load(memory_order_relaxed))},
+        List{"forked", double(Parallel::forked.load(memory_order_relaxed))},
+        List{"impure", double(Parallel::impure.load(memory_order_relaxed))},
+        List{"pause-total-us", us(s.total_pause)}, List{"pause-max-us", us(s.max_pause)}};
+    size_t bound = 4;
+    for (size_t i = 0; i + 1 < Heap::buckets; ++i, bound *= 4)
+        res.push_back(List{"pauses<" + to_string(bound) + "us", double(s.pauses[i])});
+    res.push_back(List{"pauses>=" + to_string(bound / 4) + "us", double(s.pauses[Heap::buckets - 1])});
+    return res;
+}
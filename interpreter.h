@@ -0,0 +1,39 @@
+#ifndef clispp_interpreter
+#define clispp_interpreter
+#include <memory>
+#include "lexer.h"
+#include "environment.h"
+#include "heap.h"
+
+namespace Environment {
+    using Lexer::Cell_stream;
+
+    // everything one interpreter mutates, so several can live in one process (each on its own thread)
+    class Interpreter {
+    public:
+        enum class Mode { Walk, Closures };     // tree walking or closure compiled evaluation, see compile.h
+        static Mode default_mode;
+
+        Interpreter(istream& in = cin, ostream& out = cout);
+        // fork in O(1) from a frozen base: defines go into our own e0, lookups fall through to base's
+        Interpreter(shared_ptr<Interpreter> b, istream& in = cin, ostream& out = cout);
+
+        void freeze();  // make e0 and every frame read only so forks can share them
+        List stats() const;     // ((name value) ...) for monitoring
+
+        Cell_stream cs;         // input stack, include pushes onto it
+        Lexer::Arena arena;     // parse tree of the current top-level form, see Parser::read
+        ostream* outstream;     // where results are printed
+        shared_ptr<Interpreter> base;   // frozen interpreter we were forked from, kept alive for its frames and procs
+        Env e0;                 // global environment
+        Heap heap {&e0};        // frames and procs
+        Frame_stack stack;      // frames of calls that make no closures
+        List values;            // evaluated arguments and partial results, a root for the heap
+        Mode mode {default_mode};
+
+        // frames and procs point into each other and into e0, so no copying or moving
+        Interpreter(const Interpreter&) = delete;
+        Interpreter& operator=(const Interpreter&) = delete;
+    };
+}
+#endif
@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <pthread.h>
+#include "jit.h"
+#include "interpreter.h"
+#if defined(__x86_64__) && defined(__linux__)
+#define CLISP_MACHINE_CODE
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+
+unsigned Jit::threshold {100};
+bool Jit::enabled {true};
+atomic<size_t> Jit::compiled {0};
+
+namespace Jit {
+    struct Code {
+        Entry entry;
+        size_t arity;
+        vector<string> self;    // names the body calls the proc by
+        vector<string> free;    // numbers the body reads from the proc's environment, in order
+    };
+}
+
+namespace {
+    using Jit::Code;
+
+    constexpr size_t max_args = 16;
+    constexpr size_t max_free = 16;
+    constexpr size_t code_budget = 64 << 20;    // bytes of machine code, translation stops after
+
+    const Cell* find(Env* env, const string& name) {    // lookup without throwing
+        for (Env* e = env; e; e = e->parent())
+            if (const Cell* c = e->local(name)) return c;
+        return nullptr;
+    }
+
+    // native code bails out below this, leaving the last megabyte of the thread's stack to the
+    // interpreter redoing the call, or half of a smaller stack, as Aot::run does for the main thread
+    const char* stack_limit() {
+        static thread_local const char* limit = [] {
+            pthread_attr_t attr;
+            void* end;
+            size_t size;
+            if (pthread_getattr_np(pthread_self(), &attr)) return static_cast<const char*>(__builtin_frame_address(0)) - (1 << 20);
+            pthread_attr_getstack(&attr, &end, &size);
+            pthread_attr_destroy(&attr);
+            return static_cast<const char*>(end) + (size > 2 << 20? 1 << 20 : size / 2);
+        }();
+        return limit;
+    }
+
+    mutex translating;
+    vector<unique_ptr<Code>> codes;     // never freed, procs dying leave their code behind
+    map<string, const Code*> precompiled;   // by key, filled before any interpreter runs
+
+    const Code* install(Proc& proc, unique_ptr<Code> code) {
+        codes.push_back(std::move(code));
+        proc.native.store(codes.back().get(), memory_order_release);
+        Jit::compiled.fetch_add(1, memory_order_relaxed);
+        return codes.back().get();
+    }
+
+#ifdef CLISP_MACHINE_CODE
+    struct Unsupported {};  // the body leaves the numeric subset
+
+    // emits the templates; the native code keeps the current args in rbx, the free variables in
+    // r12, the stack pointer to bail out to in r13 and the stack limit in r14, values go in xmm0
+    class Assembler {
+    public:
+        using Label = size_t;
+        Label label() { targets.push_back(0); return targets.size() - 1; }
+        void bind(Label l) { targets[l] = code.size(); }
+        vector<unsigned char> finish() {
+            for (auto& f : fixups) {
+                int32_t rel = int32_t(targets[f.second]) - int32_t(f.first + 4);
+                memcpy(&code[f.first], &rel, 4);
+            }
+            return code;
+        }
+
+        void emit(initializer_list<unsigned char> b) { code.insert(code.end(), b); }
+        void imm32(int32_t v) { unsigned char b[4]; memcpy(b, &v, 4); code.insert(code.end(), b, b + 4); }
+        void imm64(uint64_t v) { unsigned char b[8]; memcpy(b, &v, 8); code.insert(code.end(), b, b + 8); }
+        void jump(initializer_list<unsigned char> op, Label l) { emit(op); fixups.push_back({code.size(), l}); imm32(0); }
+
+        void number(double d) { uint64_t bits; memcpy(&bits, &d, 8); emit({0x48, 0xB8}); imm64(bits); emit({0x66, 0x48, 0x0F, 0x6E, 0xC0}); }  // mov rax, d; movq xmm0, rax
+        void param(size_t i) { emit({0xF2, 0x0F, 0x10, 0x83}); imm32(8 * i); }          // movsd xmm0, [rbx + 8i]
+        void free(size_t i) { emit({0xF2, 0x41, 0x0F, 0x10, 0x84, 0x24}); imm32(8 * i); }  // movsd xmm0, [r12 + 8i]
+        void push() { emit({0x48, 0x83, 0xEC, 0x08, 0xF2, 0x0F, 0x11, 0x04, 0x24}); }     // sub rsp, 8; movsd [rsp], xmm0
+        void pop() { emit({0x66, 0x0F, 0x28, 0xC8, 0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x83, 0xC4, 0x08}); }  // xmm1 = xmm0, xmm0 = popped
+        void arithmetic(Kind k) {   // xmm0 op= xmm1
+            unsigned char op = k == Kind::Add? 0x58 : k == Kind::Sub? 0x5C : k == Kind::Mul? 0x59 : 0x5E;
+            emit({0xF2, 0x0F, op, 0xC1});
+        }
+        void unless(Kind k, Label no) {     // jumps to no unless xmm0 k xmm1, as the primitive compares
+            if (k == Kind::Less) emit({0x66, 0x0F, 0x2E, 0xC8});            // ucomisd xmm1, xmm0
+            else if (k == Kind::Greater) emit({0x66, 0x0F, 0x2E, 0xC1});    // ucomisd xmm0, xmm1
+            else {  // |xmm0 - xmm1| < equal_threshold, which is a variable
+                emit({0xF2, 0x0F, 0x5C, 0xC1, 0x48, 0xB8});                // subsd xmm0, xmm1; mov rax, abs mask
+                imm64(0x7FFFFFFFFFFFFFFF);
+                emit({0x66, 0x48, 0x0F, 0x6E, 0xC8, 0x66, 0x0F, 0x54, 0xC1, 0x48, 0xB8});  // movq xmm1, rax; andpd xmm0, xmm1; mov rax, &threshold
+                imm64(reinterpret_cast<uint64_t>(&equal_threshold));
+                emit({0xF2, 0x0F, 0x10, 0x08, 0x66, 0x0F, 0x2E, 0xC8});    // movsd xmm1, [rax]; ucomisd xmm1, xmm0
+            }
+            jump({0x0F, 0x86}, no);     // jbe, also taken when unordered
+        }
+        void reserve(size_t n) { emit({0x48, 0x81, 0xEC}); imm32(8 * n); }   // sub rsp, 8n
+        void release(size_t n) { emit({0x48, 0x81, 0xC4}); imm32(8 * n); }   // add rsp, 8n
+        void store(size_t i) { emit({0xF2, 0x0F, 0x11, 0x84, 0x24}); imm32(8 * i); }     // movsd [rsp + 8i], xmm0
+        void call(Label body, Label bail) {     // args reserved at rsp
+            emit({0x4C, 0x39, 0xF4});           // cmp rsp, r14
+            jump({0x0F, 0x82}, bail);           // jb, out of stack
+            emit({0x53, 0x48, 0x8D, 0x5C, 0x24, 0x08});    // push rbx; lea rbx, [rsp + 8]
+            jump({0xE8}, body);
+            emit({0x5B});                       // pop rbx
+        }
+        void replace(size_t n) {    // args reserved at rsp become the current args
+            for (size_t i = 0; i < n; ++i) {
+                emit({0xF2, 0x0F, 0x10, 0x84, 0x24}); imm32(8 * i);     // movsd xmm0, [rsp + 8i]
+                emit({0xF2, 0x0F, 0x11, 0x83}); imm32(8 * i);           // movsd [rbx + 8i], xmm0
+            }
+        }
+        // int entry(double* args, const double* free, double* result, const char* limit)
+        void entry(Label body, Label bail) {
+            Label done = label();
+            emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});  // push rbx, r12, r13, r14, r15
+            emit({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xD7});  // mov rbx, rdi; mov r12, rsi; mov r15, rdx
+            emit({0x49, 0x89, 0xE5});                                      // mov r13, rsp
+            emit({0x49, 0x89, 0xCE});                                      // mov r14, rcx
+            jump({0xE8}, body);
+            emit({0xF2, 0x41, 0x0F, 0x11, 0x07, 0x31, 0xC0});              // movsd [r15], xmm0; xor eax, eax
+            bind(done);
+            emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});    // pop r15, r14, r13, r12, rbx; ret
+            bind(bail);
+            emit({0x4C, 0x89, 0xEC, 0xB8, 0x01, 0x00, 0x00, 0x00});        // mov rsp, r13; mov eax, 1
+            jump({0xE9}, done);
+        }
+        void ret() { emit({0xC3}); }
+
+    private:
+        vector<unsigned char> code;
+        vector<size_t> targets;
+        vector<pair<size_t, Label>> fixups;     // rel32 at offset, to label
+    };
+
+    // translates a body following Parser::eval and evlist case by case, throwing Unsupported
+    // wherever the result might not be a number computed without side effects
+    class Translator {
+    public:
+        Translator(const Proc& p) : proc(p) {
+            if (proc.params.size() > max_args) throw Unsupported{};
+            for (auto& c : proc.params) {
+                if (c.data.which() != 0) throw Unsupported{};
+                params.push_back(&boost::get<string>(c.data));
+            }
+        }
+
+        vector<unsigned char> translate() {
+            body = a.label();
+            bail = a.label();
+            a.entry(body, bail);
+            a.bind(body);
+            span(proc.body.data(), proc.body.data() + proc.body.size(), true);
+            a.ret();
+            return a.finish();
+        }
+
+        vector<string> self, free;
+
+    private:
+        enum class Use { Param, Self, Free };
+
+        Use name(const string& n, size_t& index) {
+            for (size_t i = params.size(); i-- > 0;) if (*params[i] == n) { index = i; return Use::Param; }  // the last one wins
+            const Cell* c = find(proc.env, n);
+            if (!c) throw Unsupported{};
+            if (c->kind == Kind::Proc && boost::get<Proc*>(c->data) == &proc) {
+                if (find_name(self, n) == self.size()) self.push_back(n);
+                return Use::Self;
+            }
+            if (c->kind != Kind::Number) throw Unsupported{};
+            index = find_name(free, n);
+            if (index == free.size()) {
+                if (free.size() == max_free) throw Unsupported{};
+                free.push_back(n);
+            }
+            return Use::Free;
+        }
+        static size_t find_name(const vector<string>& names, const string& n) {
+            return find(names.begin(), names.end(), n) - names.begin();
+        }
+        void variable(const Cell& c) {  // a number variable, never a proc
+            size_t i;
+            Use use = name(boost::get<string>(c.data), i);
+            if (use == Use::Self) throw Unsupported{};
+            if (use == Use::Param) a.param(i);
+            else a.free(i);
+        }
+
+        static bool arithmetic(Kind k) { return k == Kind::Add || k == Kind::Sub || k == Kind::Mul || k == Kind::Div; }
+        static bool comparison(Kind k) { return k == Kind::Less || k == Kind::Greater || k == Kind::Equal; }
+
+        void span(const Cell* p, const Cell* last, bool tail) {    // Parser::eval
+            if (p == last) throw Unsupported{};
+            switch (p->kind) {
+                case Kind::Number: a.number(boost::get<double>(p->data)); return;
+                case Kind::Name: {
+                    size_t i;
+                    Use use = name(boost::get<string>(p->data), i);
+                    if (use == Use::Self) call(p + 1, last, tail);
+                    else if (use == Use::Param) a.param(i);
+                    else a.free(i);
+                    return;
+                }
+                case Kind::Expr: list(boost::get<List>(p->data), tail); return;
+                case Kind::Cond: cond(p + 1, last, tail); return;
+                default:
+                    if (!arithmetic(p->kind)) throw Unsupported{};
+                    fold(p->kind, p + 1, last);
+            }
+        }
+
+        // an expression, where eval and evlist followed by collapse agree
+        void list(const List& l, bool tail) {
+            if (l.empty()) throw Unsupported{};
+            const Cell* p = l.data();
+            const Cell* last = p + l.size();
+            switch (p->kind) {
+                case Kind::Name: {
+                    size_t i;
+                    Use use = name(boost::get<string>(p->data), i);
+                    if (use == Use::Self) { call(p + 1, last, tail); return; }
+                    if (l.size() != 1) throw Unsupported{};
+                    if (use == Use::Param) a.param(i);
+                    else a.free(i);
+                    return;
+                }
+                case Kind::Number:
+                    if (l.size() != 1) throw Unsupported{};
+                    a.number(boost::get<double>(p->data));
+                    return;
+                case Kind::Expr:
+                    if (l.size() != 1) throw Unsupported{};
+                    list(boost::get<List>(p->data), tail);
+                    return;
+                default:
+                    if (!arithmetic(p->kind)) throw Unsupported{};
+                    fold(p->kind, p + 1, last);
+            }
+        }
+
+        void argument(const Cell& c) {  // as arguments and evlist push it
+            if (c.kind == Kind::Number) a.number(boost::get<double>(c.data));
+            else if (c.kind == Kind::Name) variable(c);
+            else if (c.kind == Kind::Expr) list(boost::get<List>(c.data), false);
+            else throw Unsupported{};
+        }
+
+        void fold(Kind k, const Cell* p, const Cell* last) {   // apply_prim on numbers
+            if (p == last) throw Unsupported{};
+            argument(*p);
+            while (++p != last) {
+                a.push();
+                argument(*p);
+                a.pop();
+                a.arithmetic(k);
+            }
+        }
+
+        void call(const Cell* p, const Cell* last, bool tail) {    // to the proc itself
+            size_t n = last - p;
+            if (n != params.size()) throw Unsupported{};
+            a.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                argument(p[i]);
+                a.store(i);
+            }
+            if (tail) {     // nothing is pending, so the frame is reused
+                a.replace(n);
+                a.release(n);
+                a.jump({0xE9}, body);
+            }
+            else {
+                a.call(body, bail);
+                a.release(n);
+            }
+        }
+
+        void test(const Cell& c, Assembler::Label no) {     // a cond test, jumping to no when false
+            if (c.kind == Kind::Number) return;     // numbers are true
+            if (c.kind == Kind::Name) { variable(c); return; }
+            if (c.kind != Kind::Expr) throw Unsupported{};
+            const List& l = boost::get<List>(c.data);
+            if (l.size() == 3 && comparison(l[0].kind)) {
+                argument(l[1]);
+                a.push();
+                argument(l[2]);
+                a.pop();
+                a.unless(l[0].kind, no);
+            }
+            else list(l, false);
+        }
+
+        void cond(const Cell* p, const Cell* last, bool tail) {
+            Assembler::Label end = a.label();
+            for (; p != last; ++p) {
+                if (p->kind != Kind::Expr) throw Unsupported{};
+                const List& clause = boost::get<List>(p->data);
+                if (clause.empty()) throw Unsupported{};
+                if (clause[0].kind == Kind::Else) {
+                    if (p + 1 != last) break;   // an error for the interpreter to raise
+                    if (clause.size() < 2) throw Unsupported{};
+                    span(&clause[1], &clause[1] + 1, tail);
+                    a.bind(end);
+                    return;
+                }
+                Assembler::Label next = a.label();
+                test(clause[0], next);
+                span(clause.data() + 1, clause.data() + clause.size(), tail);
+                a.jump({0xE9}, end);
+                a.bind(next);
+            }
+            a.jump({0xE9}, bail);   // no clause matched
+            a.bind(end);
+        }
+
+        const Proc& proc;
+        vector<const string*> params;
+        Assembler a;
+        Assembler::Label body, bail;
+    };
+
+    size_t code_size {0};
+
+    // perf's map of the code, /tmp/perf-<pid>.map, written when CLISP_PERF_MAP is set; a fork
+    // writes its own, starting with the code it inherited
+    vector<string> perf_lines;
+    FILE* perf_file {nullptr};
+
+    void open_perf_map() {
+        perf_file = fopen(("/tmp/perf-" + to_string(getpid()) + ".map").c_str(), "w");
+        if (!perf_file) return;
+        for (auto& line : perf_lines) fputs(line.c_str(), perf_file);
+        fflush(perf_file);
+    }
+
+    void perf_map(const void* p, size_t size, const string& name) {    // under translating
+        static bool wanted = getenv("CLISP_PERF_MAP");
+        if (!wanted) return;
+        char line[64];
+        snprintf(line, sizeof line, "%lx %zx clisp:", reinterpret_cast<unsigned long>(p), size);
+        perf_lines.push_back(line + name + "\n");
+        static once_flag registered;
+        call_once(registered, [] {
+            pthread_atfork([] { translating.lock(); }, [] { translating.unlock(); }, [] {
+                if (perf_file) fclose(perf_file);   // flushed after each line, so nothing is written twice
+                open_perf_map();
+                translating.unlock();
+            });
+        });
+        if (!perf_file) return open_perf_map();     // with every line so far
+        fputs(perf_lines.back().c_str(), perf_file);
+        fflush(perf_file);
+    }
+
+    const Code* machine_code(Proc& proc) {
+        unique_ptr<Code> code {new Code{nullptr, proc.params.size(), {}, {}}};
+        vector<unsigned char> bytes;
+        try {
+            Translator t {proc};
+            bytes = t.translate();
+            code->self = std::move(t.self);
+            code->free = std::move(t.free);
+        }
+        catch (Unsupported&) { return nullptr; }
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t size = (bytes.size() + page - 1) / page * page;
+        if (code_size + size > code_budget) return nullptr;
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+        memcpy(mem, bytes.data(), bytes.size());
+        if (mprotect(mem, size, PROT_READ | PROT_EXEC)) { munmap(mem, size); return nullptr; }
+        code_size += size;
+        code->entry = reinterpret_cast<Jit::Entry>(mem);
+        perf_map(mem, bytes.size(), code->self.empty()? "lambda" : code->self[0]);
+        return install(proc, std::move(code));
+    }
+#else
+    const Code* machine_code(Proc&) { return nullptr; }
+#endif
+
+    const Code* translate(Proc& proc) {
+        lock_guard<mutex> lock {translating};
+        if (const Code* code = proc.native.load(memory_order_acquire)) return code;
+        return machine_code(proc);
+    }
+
+    const Code* find_precompiled(Proc& proc) {
+        auto p = precompiled.find(Jit::key(proc.params, proc.body));
+        if (p == precompiled.end()) return nullptr;
+        lock_guard<mutex> lock {translating};
+        if (const Code* code = proc.native.load(memory_order_acquire)) return code;
+        proc.native.store(p->second, memory_order_release);
+        Jit::compiled.fetch_add(1, memory_order_relaxed);
+        return p->second;
+    }
+
+    void write_key(ostream& out, const Cell& c) {     // every number exactly, every name unambiguously
+        out << char(c.kind);
+        switch (c.data.which()) {
+            case 0: { const string& s = boost::get<string>(c.data); out << s.size() << ':' << s; break; }
+            case 1: { char b[32]; snprintf(b, sizeof b, "%a", boost::get<double>(c.data)); out << b << ';'; break; }
+            case 3: {
+                out << '(';
+                for (auto& x : boost::get<List>(c.data)) write_key(out, x);
+                out << ')';
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+string Jit::key(const List& params, const List& body) {
+    ostringstream out;
+    for (auto& c : params) write_key(out, c);
+    out << '|';
+    for (auto& c : body) write_key(out, c);
+    return out.str();
+}
+
+void Jit::precompile(const string& k, Entry entry, size_t arity, vector<string> self, vector<string> free) {
+    codes.emplace_back(new Code{entry, arity, std::move(self), std::move(free)});
+    precompiled[k] = codes.back().get();
+}
+
+bool Jit::run(Interpreter& interp, const Cell& fn, size_t args, Cell& result) {
+    if (!enabled) return false;
+    Proc& proc = *boost::get<Proc*>(fn.data);
+    const Code* code = proc.native.load(memory_order_acquire);
+    if (!code) {
+        if (proc.calls.load(memory_order_relaxed) >= threshold) return false;   // tried already
+        unsigned calls = proc.calls.fetch_add(1, memory_order_relaxed) + 1;
+        if (calls == 1 && !precompiled.empty()) code = find_precompiled(proc);
+        if (!code && calls == threshold) code = translate(proc);
+        if (!code) return false;
+    }
+    List& values = interp.values;
+    if (values.size() - args != code->arity) return false;
+    double in[max_args], free[max_free];
+    for (size_t i = 0; i < code->arity; ++i) {
+        const Cell& c = values[args + i];
+        if (c.kind != Kind::Number) return false;
+        in[i] = boost::get<double>(c.data);
+    }
+    for (auto& name : code->self) {     // still bound to the proc
+        const Cell* c = find(proc.env, name);
+        if (!c || c->kind != Kind::Proc || boost::get<Proc*>(c->data) != &proc) return false;
+    }
+    for (size_t i = 0; i < code->free.size(); ++i) {
+        const Cell* c = find(proc.env, code->free[i]);
+        if (!c || c->kind != Kind::Number) return false;
+        free[i] = boost::get<double>(c->data);
+    }
+    double res;
+    if (code->entry(in, free, &res, stack_limit())) return false;  // bailed out, nothing it did is visible
+    values.erase(values.begin() + args, values.end());
+    result = Cell{res};
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef clispp_jit
+#define clispp_jit
+#include <atomic>
+#include <string>
+#include <vector>
+#include "forward.h"
+
+// baseline JIT for x86-64 Linux: a proc called threshold times whose body only does arithmetic on
+// numbers, cond and calls to itself is translated into machine code by stitching templates, then
+// runs natively whenever its arguments and the free variables it reads are numbers; anything else
+// stays with the interpreter, and code that hits an unsupported case at run time is redone by it
+namespace Jit {
+    struct Code;
+    // 0, or 1 to leave the call to the interpreter, as it does once the stack reaches limit
+    using Entry = int (*)(double* args, const double* free, double* result, const char* limit);
+
+    extern unsigned threshold;              // calls before a proc is translated
+    extern bool enabled;                    // false runs every proc on the interpreter, set by --no-jit
+    extern std::atomic<size_t> compiled;    // procs running natively, shown by (stats)
+
+    // true if proc ran natively on the numbers at interp.values from args on, which are popped
+    bool run(Environment::Interpreter& interp, const Lexer::Cell& proc, size_t args, Lexer::Cell& result);
+
+    // code made ahead of time by --compile (see aot.h) for procs with this key, used from their first
+    // call on; registered before any interpreter runs
+    void precompile(const std::string& key, Entry entry, size_t arity, std::vector<std::string> self, std::vector<std::string> free);
+    std::string key(const Lexer::List& params, const Lexer::List& body);  // exact text of a proc
+}
+#endif
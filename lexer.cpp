@@ -1,18 +1,29 @@
 #include <cctype>
+#include <fstream>
+#include <sstream>
 #include "lexer.h"
 
 using std::string;
 using std::cout;
 using namespace Lexer;
 
-Cell_stream Lexer::cs {std::cin};
-ostream* Lexer::outstream {&std::cout};
 double Lexer::equal_threshold {0.0000001};
+std::atomic<size_t> Lexer::list_copies {0};
+map<string, string> Lexer::embedded;
 
-map<string, Kind> Lexer::keywords {{"define", Kind::Define}, {"lambda", Kind::Lambda}, {"cond", Kind::Cond},
+const map<string, Kind> Lexer::keywords {{"define", Kind::Define}, {"lambda", Kind::Lambda}, {"cond", Kind::Cond},
     {"cons", Kind::Cons}, {"car", Kind::Car}, {"cdr", Kind::Cdr}, {"list", Kind::List}, {"else", Kind::Else},
     {"empty?", Kind::Empty}, {"and", Kind::And}, {"or", Kind::Or}, {"not", Kind::Or}, {"cat", Kind::Cat},
-    {"include", Kind::Include}, {"begin", Kind::Begin}, {"let", Kind::Let}};
+    {"include", Kind::Include}, {"begin", Kind::Begin}, {"let", Kind::Let}, {"define-memo", Kind::Memo}, {"memoize", Kind::Memoize},
+    {"stats", Kind::Stats}, {"f64vector", Kind::F64}, {"f64vector->list", Kind::F64_list}, {"list->f64vector", Kind::List_f64},
+    {"f64vector-ref", Kind::F64_ref}, {"f64vector-length", Kind::F64_length}, {"f64vector-dot", Kind::F64_dot},
+    {"f64vector-sum", Kind::F64_sum}, {"f64vector-min", Kind::F64_min}, {"f64vector-max", Kind::F64_max}};
+
+void Cell_stream::include(const string& file) {
+    auto p = embedded.find(file);
+    if (p != embedded.end()) set_input(new std::istringstream{p->second});
+    else set_input(new std::ifstream{file});
+}
 
 Cell Cell_stream::get() {
     // get 1 char, decide what kind of cell is incoming,
@@ -59,10 +70,13 @@ Cell Cell_stream::get() {
         case 'c':
         case 'd':
         case 'e':
+        case 'f':
         case 'i':
         case 'l':
+        case 'm':
         case 'n':
-        case 'o': { // primitives coincidentally only start with c, d, e, or l...
+        case 'o':
+        case 's': { // keywords only start with these letters
             ip->putback(c);
             string temp;
             *ip >> temp;
@@ -70,7 +84,8 @@ Cell Cell_stream::get() {
                 temp.pop_back();
                 ip->putback(')');
             }
-            if (keywords.count(temp)) ct.kind = keywords[temp];
+            auto k = keywords.find(temp);   // read only, keywords are shared between interpreters
+            if (k != keywords.end()) ct.kind = k->second;
             else { ct.kind = Kind::Name; ct.data = temp; }
             return ct;
         }
@@ -89,13 +104,13 @@ Cell Cell_stream::get() {
     }
 }
 
-void Lexer::print(const Cell& cell) {
-    if(cell.kind != Kind::Number && cell.kind != Kind::Name && cell.kind != Kind::Expr) *outstream << static_cast<char>(cell.kind);    // primitive
-    boost::apply_visitor(print_visitor(), cell.data);
+void Lexer::print(ostream& os, const Cell& cell) {
+    if(cell.kind != Kind::Number && cell.kind != Kind::Name && cell.kind != Kind::Expr && cell.kind != Kind::F64vector) os << static_cast<char>(cell.kind);    // primitive
+    boost::apply_visitor(print_visitor(os), cell.data);
 }
 
 std::ostream& Lexer::operator<<(ostream& os, const Cell& c) {
-    print(c);
+    print(os, c);
     return os;
 }
 
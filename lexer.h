@@ -4,19 +4,27 @@
 #include <iostream>
 #include <map>
 #include <memory>   // shared_ptr
+#include <atomic>
 #include "boost/variant.hpp"
 #include "forward.h"
 
 
+namespace Parallel {
+    struct Profile_ptr {    // read at every call fork looks at, so not a shared_ptr, whose atomic loads lock
+        std::atomic<Profile*> p;    // made by the first thread to look
+        ~Profile_ptr();
+    };
+}
 
 namespace Lexer {
     using namespace std;
 	extern double equal_threshold;
-	extern ostream* outstream;
+    extern map<string, string> embedded;    // include files built into the program by --compile, by name
     enum class Kind : char {
         Include, 
-        Begin, Cat, Cons, Car, Cdr, List, Let,   // primitive procs
-        Define = 'd', Lambda = 'l', Number = '#', Name = 'n', Expr = 'e', Proc = 'p', False = 'f', True = 't', Cond = 'c', Else = ',', End = '.', Empty = ' ',   // special cases
+        Begin, Cat, Cons, Car, Cdr, List, Let, Memoize,  // primitive procs
+        F64, F64_list, List_f64, F64_ref, F64_length, F64_dot, F64_sum, F64_min, F64_max,   // f64vector primitives, see vector.h
+        F64vector = 'v', Define = 'd', Memo = 'M', Lambda = 'l', Number = '#', Name = 'n', Expr = 'e', Proc = 'p', False = 'f', True = 't', Cond = 'c', Else = ',', End = '.', Empty = ' ', Stats = 's',   // special cases
         Quote = '\'', Lp = '(', Rp = ')', And = '&', Not = '!', Or = '|',
         Mul = '*', Add = '+', Sub = '-', Div = '/', Less = '<', Equal = '=', Greater = '>',  // primitive operators
         Comment = ';'
@@ -26,9 +34,18 @@ namespace Lexer {
         List params;    
         List body;
         Environment::Env* env;
+        bool captures;  // body makes closures, so its call frames must live on the heap
+        bool defines;   // body defines, so its call frames can change after bind
+        std::shared_ptr<const Compile::Node> code;  // compiled body, when made in closure compiled mode
+        std::atomic<unsigned> calls;    // counted by Jit::run until the body is translated
+        std::atomic<const Jit::Code*> native;   // machine code for the body, see jit.h
+        size_t serial;  // never reused, so code inlining the proc can tell it from a redefinition
+        std::shared_ptr<Memo::Cache> memo;  // results by arguments, for procs made by define-memo or memoize
+        Parallel::Profile_ptr profile;  // costs and effects, once --parallel looked at the proc
     };
 
-    using Data = boost::variant<string, double, Proc*, List>;  // could make List into List*, but then introduce more management issues and indirection
+    using F64vector = std::shared_ptr<const vector<double>>;   // never changed once made, so copies share the doubles
+    using Data = boost::variant<string, double, Proc*, List, F64vector>;  // could make List into List*, but then introduce more management issues and indirection
 
     struct Cell {
         Kind kind;
@@ -41,7 +58,9 @@ namespace Lexer {
         Cell(const string& s) : kind{Kind::Name}, data{s} {}
         Cell(const char* s) : kind{Kind::Name}, data{s} {}
         Cell(Proc* p) : kind{Kind::Proc}, data{p} {}
-        Cell(List l) : kind{Kind::Expr}, data{l} {}
+        Cell(const List& l) : kind{Kind::Expr}, data{l} {}
+        Cell(List&& l) : kind{Kind::Expr}, data{std::move(l)} {}
+        Cell(F64vector v) : kind{Kind::F64vector}, data{std::move(v)} {}
         explicit Cell(bool b) : kind{b? Kind::True : Kind::False} {}
 
         // copy and move constructors
@@ -65,11 +84,13 @@ namespace Lexer {
         const Cell& current() { return ct; } // most recently get cell
         bool eof() { return ip->eof(); }
         bool base() { return old.size() == 0; }
-        void reset() { if (owns.back() == ip) { delete owns.back(); owns.pop_back(); } ip = old.back(); old.pop_back(); }
+        size_t depth() { return old.size(); }   // number of streams set_input has stacked over the base
+        void reset() { if (!owns.empty() && owns.back() == ip) { delete owns.back(); owns.pop_back(); } ip = old.back(); old.pop_back(); }
         void ignoreln() { ip->ignore(9001, '\n'); }
 
         void set_input(istream& instream_ref) { old.push_back(ip); ip = &instream_ref; }
         void set_input(istream* instream_pt) { old.push_back(ip); ip = instream_pt; owns.push_back(ip); }
+        void include(const string& file);   // set_input to the embedded file of that name, else to the file
 
     private:
         // void close() { if (owns) delete ip; }
@@ -83,72 +104,80 @@ namespace Lexer {
     ostream& operator<<(ostream&, const Cell&);
     bool operator<(const Cell&, const Cell&);
     bool operator==(const Cell&, const Cell&);
-    void print(const Cell&);
+    void print(ostream&, const Cell&);
 
-    extern Cell_stream cs;
-    extern map<string, Kind> keywords;
+    extern const map<string, Kind> keywords;
 
 
 
     // visitors
     class print_visitor : public boost::static_visitor<> {
-        string end {" "};
+        ostream* os;    // each interpreter prints to its own stream
+        const char* end {" "};
     public:
-        print_visitor() {}
-        print_visitor(string e) : end{e} {}
+        print_visitor(ostream& o) : os{&o} {}
+        print_visitor(ostream& o, const char* e) : os{&o}, end{e} {}
         void operator()(const string& str) const {
-            *outstream << str << end;
+            *os << str << end;
         }
         void operator()(const double num) const {
-            *outstream << num << end;
+            *os << num << end;
         }
         void operator()(const Lexer::Proc* proc) const {
-            *outstream << "proc" << end;
+            *os << "proc" << end;
         }
-        void operator()(const Lexer::List list) const {
-            *outstream << '(';
+        void operator()(const Lexer::List& list) const {
+            *os << '(';
             if (list.size() > 0) {
                 auto p = list.begin();
-                if(p->kind != Kind::Number && p->kind != Kind::Name && p->kind != Kind::Expr) cout << static_cast<char>(p->kind);    // primitive
+                if(p->kind != Kind::Number && p->kind != Kind::Name && p->kind != Kind::Expr && p->kind != Kind::F64vector) *os << static_cast<char>(p->kind);    // primitive
                 for (;p + 1 != list.end(); ++p) 
-                    boost::apply_visitor(print_visitor(), p->data);
-                boost::apply_visitor(print_visitor(""), p->data);
+                    boost::apply_visitor(print_visitor(*os), p->data);
+                boost::apply_visitor(print_visitor(*os, ""), p->data);
             }
-            *outstream << ')' << end;
+            *os << ')' << end;
+        }
+        void operator()(const F64vector& v) const {
+            *os << "#f64(";
+            for (size_t i = 0; i < v->size(); ++i) *os << (i? " " : "") << (*v)[i];
+            *os << ')' << end;
         }
     };
 
     class less_visitor : public boost::static_visitor<bool> {
-        // first elements stored, second elements taken as operand
-        string str;
-        double num;
-        List list;
-        Proc* proc;
+        // first elements referred to, second elements taken as operand; an operand of another type
+        // compares against that type's empty value
+        const string* str {nullptr};
+        double num {0};
+        const List* list {nullptr};
+        Proc* proc {nullptr};
     public:
-        less_visitor(const string& s) : str{s} {}
+        less_visitor(const string& s) : str{&s} {}
         less_visitor(const double d) : num{d} {}
         less_visitor(Proc* const p) : proc(p) {}
-        less_visitor(const List& l) : list{l} {}
-        bool operator()(const string& s) const { return str < s; }
+        less_visitor(const List& l) : list{&l} {}
+        bool operator()(const string& s) const { return str? *str < s : !s.empty(); }
         bool operator()(const double n) const { return num < n; }
-        bool operator()(Proc* const p) const { return (*proc).body < (*p).body; }
-        bool operator()(const List& l) const { return list < l; }
+        bool operator()(Proc* const p) const { return proc && (*proc).body < (*p).body; }
+        bool operator()(const List& l) const { return list? *list < l : !l.empty(); }
+        bool operator()(const F64vector& v) const { return !v->empty(); }
     };
 
     class equal_visitor : public boost::static_visitor<bool> {
-        string str;
-        double num;
-        List list;
-        Proc* proc;
+        const string* str {nullptr};
+        double num {0};
+        const List* list {nullptr};
+        Proc* proc {nullptr};
     public:
-        equal_visitor(const string& s) : str{s} {}
+        equal_visitor(const string& s) : str{&s} {}
         equal_visitor(const double d) : num{d} {}
         equal_visitor(Proc* const p) : proc(p) {}
-        equal_visitor(const List& l) : list{l} {}
-        bool operator()(const string& s) const { return str == s; }
+        equal_visitor(const List& l) : list{&l} {}
+        bool operator()(const string& s) const { return str? *str == s : s.empty(); }
         bool operator()(const double n) const { if (num < n) return n - num < equal_threshold; else return num - n < equal_threshold; }
         bool operator()(Proc* const p) const { return proc == p; }
-        bool operator()(const List& l) const { return list == l; }
+        bool operator()(const List& l) const { return list? *list == l : l.empty(); }
+        bool operator()(const F64vector& v) const { return v->empty(); }
     };
 }
 #endif
@@ -1,54 +1,109 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <fstream>
+#include <iostream>
 #include "parser.h"
 #include "lexer.h"
 #include "environment.h"
 #include "error.h"
+#include "server.h"
+#include "aot.h"
+#include "optimize.h"
+#include "parallel.h"
+#include "jit.h"
 
 using namespace Lexer;
 using namespace Parser;
 using namespace Environment;
 
 namespace Driver {
-    void start(bool print_res) {
-        envs.reserve(max_capacity * 4); // reserve to preserve pointers
-        procs.reserve(max_capacity);
-        envs.push_back(e0);
+    int usage() {
+        cerr << "usage: clisp [options] [file [-p]]\n"
+                "       clisp [options] --compile foo.scm [-o foo]\n"
+                "       clisp [options] --prefork N socket [prelude...]\n"
+                "       clisp [options] --serve N socket [prelude...]\n"
+                "options: --closures --accumulate --no-jit --pause-us N --parallel N\n";
+        return 2;
+    }
+
+    bool number(const char* s, long least, long& n) {   // all of s, a decimal integer of at least least
+        char* end;
+        errno = 0;
+        n = strtol(s, &end, 10);
+        return *s && !*end && !errno && n >= least && n <= INT_MAX;
+    }
 
+    void start(Interpreter& interp, bool print_res) {
+        Cell_stream& cs = interp.cs;
+        ostream& out = *interp.outstream;
         while (true) {
-            if (print_res) cout << "> ";
+            if (print_res) out << "> ";
             try {
-                auto res = eval(expr(true), &e0);
+                auto res = eval(interp, read(interp), &interp.e0);
                 if (print_res)
-                    cout << res << '\n';    
-                if (res.kind == Kind::End || cs.eof()) { cs.reset(); if (cs.base()) print_res = true; }
+                    out << res << '\n';    
+                interp.heap.end_region(res);
+                if (res.kind == Kind::End || cs.eof()) {
+                    if (cs.base()) return;  // end of standard input
+                    cs.reset();
+                    if (cs.base()) print_res = true;
+                }
             }
             catch (exception& e) {
-                cout << e.what() << endl;    // continue loop
+                out << e.what() << endl;    // continue loop
             }
         }
     }
 }
 
 int main(int argc, char* argv[]) {
+    int i = 1;
+    long n;
+    for (; i < argc && string{argv[i]}.compare(0, 2, "--") == 0; ++i) {   // options, in any order
+        string option {argv[i]};
+        if (option == "--closures")         // compile each form to closures before running it
+            Interpreter::default_mode = Interpreter::Mode::Closures;
+        else if (option == "--accumulate")  // rewrite linear recursion into loops
+            Optimize::accumulate = true;
+        else if (option == "--no-jit")      // run every proc on the interpreter
+            Jit::enabled = false;
+        else if (option == "--pause-us" && i + 1 < argc && Driver::number(argv[++i], 0, n))  // target for each step of a major collection
+            Heap::default_pause = chrono::microseconds{n};
+        else if (option == "--parallel" && i + 1 < argc && Driver::number(argv[++i], 0, n))  // fork costly pure arguments to N threads
+            Parallel::threads = n;
+        else if (option == "--compile" && (argc - i == 2 || (argc - i == 4 && string{argv[i + 2]} == "-o"))) {  // --compile foo.scm [-o foo]
+            string script {argv[i + 1]};
+            string output {script.size() > 4 && script.substr(script.size() - 4) == ".scm"? script.substr(0, script.size() - 4) : script + ".out"};
+            if (argc - i == 4) output = argv[i + 3];
+            return Aot::compile(script, output);
+        }
+        else if (option == "--prefork" && i + 2 < argc && Driver::number(argv[i + 1], 1, n))   // --prefork N socket [prelude...]
+            return Server::prefork(n, argv[i + 2], {argv + i + 3, argv + argc});
+        else if (option == "--serve" && i + 2 < argc && Driver::number(argv[i + 1], 1, n))     // --serve N socket [prelude...]
+            return Server::serve(n, argv[i + 2], {argv + i + 3, argv + argc});
+        else return Driver::usage();
+    }
+    Interpreter interp;
+    Cell_stream& cs = interp.cs;
     bool print_res {false};
-    switch (argc) {
-        case 1:
+    switch (argc - i) {
+        case 0:
             print_res = true;
             break;
-        case 2:
-            cs.set_input(new ifstream{argv[1]});
+        case 1:
+            cs.set_input(new ifstream{argv[i]});
             break;
-        case 3: {
-            cs.set_input(new ifstream{argv[1]});
-            string option {argv[2]};
+        case 2: {
+            cs.set_input(new ifstream{argv[i]});
+            string option {argv[i + 1]};
             if (option == "-p" || option == "-print") print_res = true;
             break;
         }
         default:
-            throw runtime_error("too many arguments");
-            return 1;
+            return Driver::usage();
     }
-    Driver::start(print_res);
+    Driver::start(interp, print_res);
 
     return 0;
 }
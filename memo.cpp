@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <functional>
+#include "memo.h"
+#include "compile.h"
+#include "interpreter.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+
+atomic<size_t> Memo::hits {0};
+atomic<size_t> Memo::misses {0};
+atomic<size_t> Memo::evictions {0};
+size_t Memo::default_capacity {1024};
+
+namespace {
+    bool storable(const Cell& c) {  // holds no proc, which the heap would have to see
+        if (c.kind == Kind::Proc) return false;
+        if (c.kind != Kind::Expr) return true;
+        const List& l = boost::get<List>(c.data);
+        return all_of(l.begin(), l.end(), storable);
+    }
+
+    void combine(size_t& h, size_t v) { h ^= v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2); }
+
+    size_t hash_cell(const Cell& c) {   // keywords leave whatever was read before in data, so only names, numbers, lists and f64vectors look at it
+        size_t h = size_t(c.kind);
+        switch (c.kind) {
+            case Kind::Number: {
+                double d = boost::get<double>(c.data);
+                combine(h, std::hash<double>()(d == 0? 0.0 : d));   // 0 == -0
+                break;
+            }
+            case Kind::Name: combine(h, std::hash<string>()(boost::get<string>(c.data))); break;
+            case Kind::Expr: for (auto& e : boost::get<List>(c.data)) combine(h, hash_cell(e)); break;
+            case Kind::F64vector: for (double d : *boost::get<F64vector>(c.data)) combine(h, std::hash<double>()(d == 0? 0.0 : d)); break;
+            default: break;
+        }
+        return h;
+    }
+
+    bool same(const Cell& a, const Cell& b) {
+        if (a.kind != b.kind) return false;
+        switch (a.kind) {
+            case Kind::Number: return boost::get<double>(a.data) == boost::get<double>(b.data);
+            case Kind::Name: return boost::get<string>(a.data) == boost::get<string>(b.data);
+            case Kind::Expr: {
+                const List& x = boost::get<List>(a.data);
+                const List& y = boost::get<List>(b.data);
+                return x.size() == y.size() && equal(x.begin(), x.end(), y.begin(), same);
+            }
+            case Kind::F64vector: return *boost::get<F64vector>(a.data) == *boost::get<F64vector>(b.data);
+            default: return true;
+        }
+    }
+}
+
+size_t Memo::Cache::Hash::operator()(const Key& k) const {
+    size_t h = k.last - k.first;
+    for (auto p = k.first; p != k.last; ++p) combine(h, hash_cell(*p));
+    return h;
+}
+
+bool Memo::Cache::Equal::operator()(const Key& a, const Key& b) const {
+    return a.last - a.first == b.last - b.first && equal(a.first, a.last, b.first, same);
+}
+
+bool Memo::Cache::find(Parser::Span args, Cell& result) {
+    lock_guard<mutex> lock {m};
+    auto p = index.find({args.begin(), args.end()});
+    if (p == index.end()) return false;
+    entries.splice(entries.begin(), entries, p->second);
+    result = p->second->result;
+    return true;
+}
+
+void Memo::Cache::insert(List args, const Cell& result) {
+    lock_guard<mutex> lock {m};
+    Key key {args.data(), args.data() + args.size()};
+    if (index.count(key)) return;   // filled by another thread meanwhile
+    if (entries.size() == capacity) {
+        const List& old = entries.back().args;
+        index.erase({old.data(), old.data() + old.size()});
+        entries.pop_back();
+        evictions.fetch_add(1, memory_order_relaxed);
+    }
+    entries.push_front({std::move(args), result});
+    const List& a = entries.front().args;     // the vector's buffer moved with it
+    index.emplace(Key{a.data(), a.data() + a.size()}, entries.begin());
+}
+
+bool Memo::run(Interpreter& interp, const Cell& fn, size_t args, Cell& result) {
+    const Proc& proc = *boost::get<Proc*>(fn.data);
+    if (!proc.memo) return false;
+    List& values = interp.values;
+    if (!all_of(values.begin() + args, values.end(), storable)) return false;
+    if (proc.memo->find({values.data() + args, values.data() + values.size()}, result)) {
+        values.erase(values.begin() + args, values.end());
+        hits.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    misses.fetch_add(1, memory_order_relaxed);
+    List key {values.begin() + args, values.end()};     // enter moves the arguments into the frame
+    Roots roots {interp.heap};
+    roots.add(&fn);     // the name it was called by may be redefined by the body
+    {
+        Frame_mark mark {interp.stack};
+        Env* frame = Parser::enter(interp, fn, args);
+        result = proc.code? Compile::body(interp, proc, frame) : Parser::eval(interp, Parser::Span{proc.body}, frame);
+    }
+    if (storable(result)) proc.memo->insert(std::move(key), result);
+    return true;
+}
+
+Cell Memo::memoize(Interpreter& interp, Parser::Values args) {
+    if (args.empty() || args.size() > 2 || args[0].kind != Kind::Proc) throw runtime_error("memoize expects a proc and an optional capacity");
+    const Proc& f = *boost::get<Proc*>(args[0].data);
+    size_t n = args.size() == 2? capacity({&args[1], args.end()}) : default_capacity;
+    Proc* proc = interp.heap.make_proc(f.params, f.body, f.env, f.captures, f.defines);
+    proc->code = f.code;
+    attach(*proc, n);
+    return {proc};
+}
+
+size_t Memo::capacity(Parser::Span rest) {
+    if (rest.empty()) return default_capacity;
+    if (rest[0].kind != Kind::Number || boost::get<double>(rest[0].data) < 1) throw runtime_error("Memo capacity must be a positive number");
+    return size_t(boost::get<double>(rest[0].data));
+}
+
+void Memo::attach(Proc& proc, size_t capacity) {
+    proc.memo = make_shared<Cache>(capacity);
+}
@@ -0,0 +1,46 @@
+#ifndef clispp_memo
+#define clispp_memo
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "parser_impl.h"
+
+// memoized procs, made by (define-memo (name params...) body [capacity]) or (memoize proc [capacity]):
+// each keeps its own cache from argument lists to results, compared by structure with numbers taken
+// exactly, which drops the least recently used entry once it holds capacity of them. Calls whose
+// arguments or result hold a proc run as any other, so the heap never has to trace a cache
+namespace Memo {
+    using namespace Lexer;
+
+    extern std::atomic<size_t> hits;        // calls answered from a cache, shown by (stats)
+    extern std::atomic<size_t> misses;      // calls that ran the body to fill one
+    extern std::atomic<size_t> evictions;   // entries dropped to make room
+    extern size_t default_capacity;         // entries kept when no capacity is given
+
+    class Cache {
+    public:
+        explicit Cache(size_t c) : capacity{c} {}
+        bool find(Parser::Span args, Cell& result);     // makes the entry the most recently used
+        void insert(List args, const Cell& result);
+    private:
+        struct Key { const Cell* first; const Cell* last; };    // arguments, in the entry or being looked up
+        struct Hash { size_t operator()(const Key& k) const; };
+        struct Equal { bool operator()(const Key& a, const Key& b) const; };
+        struct Entry { List args; Cell result; };
+
+        std::mutex m;   // procs of a frozen base are called from every fork
+        size_t capacity;
+        std::list<Entry> entries;   // most recently used first, nodes never move
+        std::unordered_map<Key, std::list<Entry>::iterator, Hash, Equal> index;
+    };
+
+    // true if proc is memoized and its arguments, interp.values from args on, can be cached; result
+    // is then its value for them, from the cache or the body, and the arguments are popped
+    bool run(Environment::Interpreter& interp, const Cell& proc, size_t args, Cell& result);
+
+    Cell memoize(Environment::Interpreter& interp, Parser::Values args);  // a memoized copy of (memoize proc [capacity])
+    size_t capacity(Parser::Span rest);     // the one rest may give after a define-memo body
+    void attach(Proc& proc, size_t capacity);
+}
+#endif
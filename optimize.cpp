@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <iterator>
+#include "optimize.h"
+#include "parser_impl.h"
+
+using namespace std;
+using namespace Lexer;
+
+atomic<size_t> Optimize::folds {0};
+atomic<size_t> Optimize::pruned {0};
+atomic<size_t> Optimize::identities {0};
+atomic<size_t> Optimize::accumulated {0};
+bool Optimize::accumulate {false};
+
+namespace {
+    using Allocator = Arena_allocator<Cell>;
+
+    bool is_list(const Cell& c) { return c.data.which() == 3; }
+
+    bool primitive(Kind k) {    // applied by apply_prim, which only depends on its arguments
+        switch (k) {
+            case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal:
+            case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
+            case Kind::Empty:
+            case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+            case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max:
+                return true;
+            default: return false;
+        }
+    }
+    bool arithmetic(Kind k) { return k == Kind::Add || k == Kind::Sub || k == Kind::Mul || k == Kind::Div; }
+    bool binary(Kind k) { return k == Kind::Less || k == Kind::Greater || k == Kind::Equal || k == Kind::Cons; }
+
+    // an operand evlist always pushes the same value for: a number, () or an expression of one
+    // number or one quote
+    bool constant(const Cell& c, Cell& value) {
+        if (c.kind == Kind::Number) { value = c; return true; }
+        if (c.kind != Kind::Expr) return false;
+        const List& l = boost::get<List>(c.data);
+        if (l.empty()) { value = Cell{List{}}; return true; }   // collapse of nothing
+        if (l.size() == 1 && l[0].kind == Kind::Number) { value = l[0]; return true; }
+        if (l.size() == 2 && l[0].kind == Kind::Quote) { value = l[1]; return true; }
+        return false;
+    }
+
+    bool operands(const Cell* p, const Cell* last, List& values) {
+        for (; p != last; ++p) {
+            Cell v;
+            if (p->kind == Kind::Quote) {
+                if (p + 1 == last) return false;
+                v = *++p;
+            }
+            else if (!constant(*p, v)) return false;
+            values.push_back(std::move(v));
+        }
+        return true;
+    }
+
+    // the value of a primitive applied to constants; false when it is left to raise its error at
+    // run time, or reads past its arguments there
+    bool fold(const List& l, Cell& value) {
+        if (l.size() < 2 || !primitive(l[0].kind)) return false;
+        List args;
+        if (!operands(l.data() + 1, l.data() + l.size(), args) || args.empty()) return false;
+        if (binary(l[0].kind) && args.size() < 2) return false;
+        if ((l[0].kind == Kind::Car || l[0].kind == Kind::Cdr) && args[0].kind == Kind::Expr && boost::get<List>(args[0].data).empty()) return false;
+        try { value = Parser::apply_prim(l[0], {args.data(), args.data() + args.size()}); }
+        catch (exception&) { return false; }
+        Optimize::folds.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    // a value in place of an expression: a number cell where Parser's arguments would read it the
+    // same as the expression, else a quote of it
+    Cell literal(Cell value, bool number, const Allocator& alloc) {
+        if (number && value.kind == Kind::Number) return value;
+        List quoted {alloc};
+        quoted.push_back({Kind::Quote});
+        quoted.push_back(std::move(value));
+        return {std::move(quoted)};
+    }
+
+    // a name after the numbers and quotes following an operand, which would be taken as the value
+    // of a variable rather than called once Parser's arguments no longer stops at the operand
+    bool name_follows(const Cell* p, const Cell* last) {
+        for (; p != last; ++p) {
+            if (p->kind == Kind::Name) return true;
+            if (p->kind == Kind::Quote) { if (++p == last) return false; }
+            else if (p->kind != Kind::Number) return false;
+        }
+        return false;
+    }
+
+    // drops 0 from + and -, 1 from * and /, never the first operand of - and /, nor an operand after
+    // a name, which might be a proc taking the rest as its arguments; (+ x 0) of a -0 gives -0
+    void simplify(List& l) {
+        if (l.size() < 3 || !arithmetic(l[0].kind)) return;
+        double unit = l[0].kind == Kind::Add || l[0].kind == Kind::Sub? 0 : 1;
+        bool commutes = l[0].kind == Kind::Add || l[0].kind == Kind::Mul;
+        for (size_t i = 1; i < l.size() && l.size() > 2;) {
+            const Cell& c = l[i];
+            if (c.kind == Kind::Quote) { i += 2; continue; }
+            if (c.kind != Kind::Number && c.kind != Kind::Expr) return;
+            if (c.kind == Kind::Number && boost::get<double>(c.data) == unit && (commutes || i > 1)) {
+                l.erase(l.begin() + i);
+                Optimize::identities.fetch_add(1, memory_order_relaxed);
+            }
+            else ++i;
+        }
+    }
+
+    // (+ e) of an arithmetic expression e is e
+    bool single(const List& l) {
+        if (l.size() != 2 || !arithmetic(l[0].kind) || l[1].kind != Kind::Expr) return false;
+        const List& inner = boost::get<List>(l[1].data);
+        return !inner.empty() && arithmetic(inner[0].kind);
+    }
+
+    bool constant_test(const Cell& c, bool& truth) {
+        Cell v;
+        if (!constant(c, v)) return false;
+        truth = v.kind != Kind::False;
+        return true;
+    }
+
+    void body(List& l);
+    void value(Cell& c, bool number);
+
+    // a clause's test is evaluated on its own, and its body either as a span by eval or, when cond
+    // runs under evlist, as the cells of an expression that goes on after the test
+    void clause(Cell& c);
+
+    // the cells of a span in the order eval and evlist get to them; after_name is set where a name
+    // before them may be a proc whose arguments they are
+    void span(Cell* p, Cell* last, bool after_name = false) {
+        for (; p != last; ++p) {
+            switch (p->kind) {
+                case Kind::Include: return;
+                case Kind::Quote:
+                    if (p + 1 == last) return;
+                    ++p;    // never looked into
+                    break;
+                case Kind::Lambda:
+                    if (last - p < 3) return;
+                    if (is_list(p[2])) body(boost::get<List>(p[2].data));
+                    p += 2;
+                    break;
+                case Kind::Define: case Kind::Memo:
+                    if (last - p < 3) return;
+                    if (p[1].kind == Kind::Name) span(p + 2, last);
+                    else if (p[1].kind == Kind::Expr && is_list(p[2])) body(boost::get<List>(p[2].data));
+                    return;
+                case Kind::Let:
+                    if (last - p < 3 || !is_list(p[1])) return;
+                    for (auto& pair : boost::get<List>(p[1].data))
+                        if (is_list(pair) && boost::get<List>(pair.data).size() >= 2) value(boost::get<List>(pair.data)[1], true);
+                    if (p[2].kind == Kind::Expr) body(boost::get<List>(p[2].data));
+                    return;
+                case Kind::Cond:
+                    for (auto q = p + 1; q != last; ++q) clause(*q);
+                    return;
+                case Kind::Begin: span(p + 1, last); return;
+                case Kind::Expr: value(*p, !after_name || !name_follows(p + 1, last)); break;
+                case Kind::Name: after_name = true; break;
+                default: break;
+            }
+        }
+    }
+
+    void clause(Cell& c) {
+        if (!is_list(c)) return;
+        List& l = boost::get<List>(c.data);
+        if (l.empty()) return;
+        if (l[0].kind != Kind::Else) value(l[0], true);
+        span(l.data() + 1, l.data() + l.size(), l[0].kind == Kind::Name);
+    }
+
+    void value(Cell& c, bool number) {  // an operand or expression evaluated for its value
+        if (c.kind != Kind::Expr) return;
+        List& l = boost::get<List>(c.data);
+        span(l.data(), l.data() + l.size());
+        Cell v;
+        if (fold(l, v)) { c = literal(std::move(v), number, l.get_allocator()); return; }
+        simplify(l);
+        if (single(l)) { Cell inner {std::move(l[1])}; c = std::move(inner); }
+    }
+
+    // clauses of a cond eval runs that come after one whose test is always true, or whose own test
+    // is always false, are never reached; a first clause always reached leaves the list its body.
+    // Under evlist cond goes on after the clause that matched, so only lists eval runs get here
+    bool prune(List& l) {
+        for (size_t i = 1; i < l.size(); ++i) {
+            if (!is_list(l[i])) return false;
+            const List& clause = boost::get<List>(l[i].data);
+            bool truth;
+            if (clause.empty() || clause[0].kind == Kind::Else) break;
+            if (!constant_test(clause[0], truth)) continue;
+            if (truth) {
+                Optimize::pruned.fetch_add(l.size() - i - 1, memory_order_relaxed);
+                l.erase(l.begin() + i + 1, l.end());
+                break;
+            }
+            l.erase(l.begin() + i--);
+            Optimize::pruned.fetch_add(1, memory_order_relaxed);
+        }
+        if (l.size() < 2 || !is_list(l[1])) return false;
+        List& first = boost::get<List>(l[1].data);
+        bool truth;
+        List rest {l.get_allocator()};
+        if (first.empty()) return false;
+        if (first[0].kind == Kind::Else) {
+            if (l.size() != 2 || first.size() < 2) return false;
+            rest.push_back(std::move(first[1]));
+        }
+        else if (constant_test(first[0], truth) && truth)
+            rest.insert(rest.end(), make_move_iterator(first.begin() + 1), make_move_iterator(first.end()));
+        else return false;
+        l = std::move(rest);
+        Optimize::pruned.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    void reduce(List& l) {  // the list as a whole, once its cells are done
+        Cell v;
+        if (fold(l, v)) {
+            List res {l.get_allocator()};
+            if (v.kind != Kind::Number) res.push_back({Kind::Quote});
+            res.push_back(std::move(v));
+            l = std::move(res);
+            return;
+        }
+        if (!l.empty() && l[0].kind == Kind::Cond) {
+            if (prune(l)) reduce(l);
+            return;
+        }
+        simplify(l);
+        if (single(l)) { List inner {std::move(boost::get<List>(l[1].data))}; l = std::move(inner); }
+    }
+
+    void body(List& l) {    // a list eval runs as a whole: a form, a proc body or a let body
+        span(l.data(), l.data() + l.size());
+        reduce(l);
+    }
+}
+
+namespace {
+    // linear recursion into accumulator loops, see Optimize::accumulate
+
+    bool free_of(const Cell& c, const string& name) {   // never names it, nor binds anything
+        switch (c.kind) {
+            case Kind::Name: return boost::get<string>(c.data) != name;
+            case Kind::Define: case Kind::Memo: case Kind::Lambda: case Kind::Let: case Kind::Include: case Kind::Begin: return false;
+            case Kind::Expr: {
+                const List& l = boost::get<List>(c.data);
+                for (auto p = l.begin(); p != l.end(); ++p) {
+                    if (p->kind == Kind::Quote) { if (++p == l.end()) return false; }
+                    else if (!free_of(*p, name)) return false;
+                }
+                return true;
+            }
+            default: return true;
+        }
+    }
+
+    // (name args...) with as many args as params, none of which names it
+    bool self_call(const Cell& c, const string& name, size_t params) {
+        if (c.kind != Kind::Expr) return false;
+        const List& l = boost::get<List>(c.data);
+        if (l.size() != params + 1 || l[0].kind != Kind::Name || boost::get<string>(l[0].data) != name) return false;
+        return all_of(l.begin() + 1, l.end(), [&](const Cell& a) { return a.kind != Kind::Quote && free_of(a, name); });
+    }
+
+    // the clauses of the loop: a clause whose body is (op x (name args...)) goes on with (op x acc)
+    // passed after args; (op (name args...) x) only when x is a number or a name, whose value does not
+    // depend on when it is read; a bare (name args...) goes on with the accumulator as it is; any other
+    // body is folded into the accumulator as the result. Bodies are one cell
+    bool loop_clauses(const List& body, const string& name, size_t params, const string& acc, const string& loop, Kind& op, List& res) {
+        if (body.size() < 2 || body[0].kind != Kind::Cond) return false;
+        auto alloc = body.get_allocator();
+        op = Kind::End;
+        res.push_back(body[0]);
+        vector<pair<size_t, const Cell*>> results;  // the clause, and the body folded into the accumulator
+        for (auto c = body.begin() + 1; c != body.end(); ++c) {
+            if (c->kind != Kind::Expr) return false;
+            const List& clause = boost::get<List>(c->data);
+            if (clause.size() != 2 || !free_of(clause[0], name)) return false;
+            const Cell& b = clause[1];
+            List out {alloc};
+            out.push_back(clause[0]);
+            List call {alloc};
+            call.push_back(Cell{loop});
+            if (self_call(b, name, params)) {
+                const List& l = boost::get<List>(b.data);
+                call.insert(call.end(), l.begin() + 1, l.end());
+                call.push_back(Cell{acc});
+            }
+            else if (b.kind == Kind::Expr && boost::get<List>(b.data).size() == 3) {
+                const List& l = boost::get<List>(b.data);
+                Kind k = l[0].kind;
+                bool first = self_call(l[1], name, params);
+                if (k != Kind::Add && k != Kind::Mul && k != Kind::Cons) return false;
+                if (op != Kind::End && op != k) return false;
+                const Cell& x = first? l[2] : l[1];
+                const Cell& rec = first? l[1] : l[2];
+                if (!self_call(rec, name, params) || !free_of(x, name)) return false;
+                if (x.kind != Kind::Number && x.kind != Kind::Name && (first || x.kind != Kind::Expr)) return false;
+                if (first && k == Kind::Cons) return false;
+                op = k;
+                List folded {alloc};
+                folded.push_back(l[0]);
+                if (first) { folded.push_back(Cell{acc}); folded.push_back(x); }
+                else { folded.push_back(x); folded.push_back(Cell{acc}); }
+                const List& r = boost::get<List>(rec.data);
+                call.insert(call.end(), r.begin() + 1, r.end());
+                call.push_back(std::move(folded));
+            }
+            else {
+                if (b.kind != Kind::Number && b.kind != Kind::Name && b.kind != Kind::Expr) return false;
+                if (!free_of(b, name)) return false;
+                results.emplace_back(res.size(), &b);
+                res.push_back(std::move(out));
+                continue;
+            }
+            out.push_back(std::move(call));
+            res.push_back(std::move(out));
+        }
+        if (op == Kind::End) return false;
+        for (auto& r : results) {
+            List folded {alloc};
+            if (op == Kind::Cons) {     // the conses made on the way down, in front of the result
+                folded.push_back(Cell{string{"reverse onto"}});
+                folded.push_back(Cell{acc});
+                List value {alloc};     // the same as eval of the clause body: evlist collapsed
+                value.push_back(*r.second);
+                folded.push_back(std::move(value));
+            }
+            else {
+                folded.push_back({op});
+                folded.push_back(Cell{acc});
+                folded.push_back(*r.second);
+            }
+            boost::get<List>(res[r.first].data).push_back(std::move(folded));
+        }
+        return true;
+    }
+
+    Cell define(const List& head, Cell body, const Allocator& alloc) {  // (define (head...) body)
+        List d {alloc};
+        d.push_back({Kind::Define});
+        d.push_back(head);
+        d.push_back(std::move(body));
+        return {std::move(d)};
+    }
+
+    // (reverse onto a b), b with the elements of a consed onto it from the last
+    Cell reverse_onto(const Allocator& alloc) {
+        auto list = [&](initializer_list<Cell> cells) { return Cell{List{cells, alloc}}; };
+        Cell name {string{"reverse onto"}};
+        Cell body = list({{Kind::Cond},
+            list({list({{Kind::Empty}, "a"}), "b"}),
+            list({{Kind::Else}, list({name, list({{Kind::Cdr}, "a"}), list({{Kind::Cons}, list({{Kind::Car}, "a"}), "b"})})})});
+        return define(boost::get<List>(list({name, "a", "b"}).data), body, alloc);
+    }
+
+    // (define (f params...) (cond ...)), or with a lambda, where the clauses recurse through an
+    // associative op becomes a loop carrying the op's result so far, and f calls it with the op's unit
+    void accumulator_loop(List& form) {
+        if (form.size() != 3 || form[0].kind != Kind::Define) return;
+        const List* params;
+        const Cell* body;
+        string name;
+        List lambda;
+        if (form[1].kind == Kind::Expr) {
+            const List& head = boost::get<List>(form[1].data);
+            if (head.empty() || head[0].kind != Kind::Name) return;
+            name = boost::get<string>(head[0].data);
+            lambda.assign(head.begin() + 1, head.end());
+            params = &lambda;
+            body = &form[2];
+        }
+        else if (form[1].kind == Kind::Name && form[2].kind == Kind::Expr) {
+            const List& l = boost::get<List>(form[2].data);
+            if (l.size() != 3 || l[0].kind != Kind::Lambda || l[1].kind != Kind::Expr) return;
+            name = boost::get<string>(form[1].data);
+            params = &boost::get<List>(l[1].data);
+            body = &l[2];
+        }
+        else return;
+        if (body->kind != Kind::Expr) return;
+        for (auto& p : *params) if (p.kind != Kind::Name || boost::get<string>(p.data) == name) return;
+        auto alloc = form.get_allocator();
+        string acc {name + " accumulator"}, loop {name + " loop"};    // names the lexer never gives
+        Kind op;
+        List clauses {alloc};
+        if (!loop_clauses(boost::get<List>(body->data), name, params->size(), acc, loop, op, clauses)) return;
+        List head {alloc};
+        head.push_back(Cell{loop});
+        head.insert(head.end(), params->begin(), params->end());
+        head.push_back(Cell{acc});
+        List start {alloc};
+        start.push_back(Cell{loop});
+        start.insert(start.end(), params->begin(), params->end());
+        if (op == Kind::Cons) {
+            start.push_back({Kind::Quote});
+            start.push_back(List{alloc});
+        }
+        else start.push_back(Cell{op == Kind::Add? 0.0 : 1.0});
+        List res {alloc};
+        res.push_back({Kind::Begin});
+        if (op == Kind::Cons) res.push_back(reverse_onto(alloc));
+        res.push_back(define(head, std::move(clauses), alloc));
+        if (form[1].kind == Kind::Expr) res.push_back(define(boost::get<List>(form[1].data), std::move(start), alloc));
+        else {
+            List& l = boost::get<List>(form[2].data);
+            l[2] = std::move(start);
+            List d {alloc};
+            d.insert(d.end(), make_move_iterator(form.begin()), make_move_iterator(form.end()));
+            res.push_back(std::move(d));
+        }
+        form = std::move(res);
+        Optimize::accumulated.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void Optimize::form(List& form) {
+    body(form);
+    if (accumulate) accumulator_loop(form);
+}
@@ -0,0 +1,27 @@
+#ifndef clispp_optimize
+#define clispp_optimize
+#include <atomic>
+#include "forward.h"
+
+// rewrites a parsed form before it is evaluated: primitive applications on literals are folded into
+// their value, cond clauses whose test is constant are pruned and identity operands ((+ e 0), (* e 1),
+// (- e 0), (/ e 1)) are dropped; names are never assumed to hold anything, so a redefinition is always
+// seen, and every rewrite gives what Parser::eval and evlist would have given for the original
+//
+// With accumulate set, a define whose cond clauses recurse through + or * on a value computed
+// before the call, as (* n (f (- n 1))) does, or through cons, becomes a tail-recursive loop
+// carrying the result so far, so deep inputs run in constant space. The sums and products are
+// taken from the outermost call in, which only rounds differently past 2^53; the value folded in
+// is computed after the next call's arguments, which only shows in which of two errors is raised,
+// a name holding a proc there or after an expression argument is called on the accumulator rather
+// than on the recursion's value, and the loop keeps calling itself if f is redefined while it runs
+namespace Optimize {
+    extern std::atomic<size_t> folds;       // applications folded into constants, shown by (stats)
+    extern std::atomic<size_t> pruned;      // cond clauses dropped or collapsed
+    extern std::atomic<size_t> identities;  // identity operands dropped
+    extern std::atomic<size_t> accumulated; // defines turned into accumulator loops
+    extern bool accumulate;     // set by --accumulate, before any interpreter reads
+
+    void form(Lexer::List& form);   // a top-level form, as Parser::read gives it to eval
+}
+#endif
@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include "parallel.h"
+#include "compile.h"
+#include "interpreter.h"
+
+using namespace std;
+using namespace Lexer;
+using namespace Environment;
+using Parser::Span;
+
+atomic<size_t> Parallel::forked {0};
+atomic<size_t> Parallel::impure {0};
+size_t Parallel::threads {0};
+double Parallel::min_cost_us {100};
+
+struct Parallel::Profile {
+    static constexpr size_t buckets = 128;  // argument sizes 0 to 63 each, then one per power of two
+    atomic<unsigned> runs[buckets] {};
+    atomic<uint64_t> ns[buckets] {};        // moving average of the runs timed
+    once_flag analyzed;
+    bool effects {false};   // the body defines, includes or reads (stats)
+    vector<const string*> free;     // names the body looks up in the proc's env, in its body
+};
+
+Parallel::Profile_ptr::~Profile_ptr() { delete p.load(memory_order_relaxed); }
+
+namespace {
+    using Parallel::Profile;
+    using Clock = chrono::steady_clock;
+
+    const Cell* find(Env* env, const string& name) {    // lookup without throwing
+        for (Env* e = env; e; e = e->parent())
+            if (const Cell* c = e->local(name)) return c;
+        return nullptr;
+    }
+
+    bool is_list(const Cell& c) { return c.data.which() == 3; }
+
+    // effect analysis: cells are pure if nothing they evaluate defines, includes or reads (stats),
+    // and every proc the names they look up hold, or hold in a list, is pure; there is no output
+
+    bool effects(Span cells) {
+        for (auto p = cells.begin(); p != cells.end(); ++p) {
+            switch (p->kind) {
+                case Kind::Define: case Kind::Memo: case Kind::Include: case Kind::Stats: return true;
+                case Kind::Quote: if (p + 1 != cells.end()) ++p; break;    // never evaluated
+                case Kind::Expr: if (effects(boost::get<List>(p->data))) return true; break;
+                default: break;
+            }
+        }
+        return false;
+    }
+
+    bool bound_in(const vector<const string*>& names, const string& name) {
+        return find_if(names.begin(), names.end(), [&](const string* n) { return *n == name; }) != names.end();
+    }
+
+    // the names cells look up that they do not bind themselves, for cells without effects
+    void names(Span cells, vector<const string*>& bound, vector<const string*>& free) {
+        size_t outer = bound.size();
+        for (auto p = cells.begin(); p != cells.end(); ++p) {
+            switch (p->kind) {
+                case Kind::Quote: if (p + 1 != cells.end()) ++p; break;
+                case Kind::Name: {
+                    const string& n = boost::get<string>(p->data);
+                    if (!bound_in(bound, n) && !bound_in(free, n)) free.push_back(&n);
+                    break;
+                }
+                case Kind::Expr: names(boost::get<List>(p->data), bound, free); break;
+                case Kind::Lambda:      // (lambda (params) (body)), the params are bound in the body only
+                    if (cells.end() - p < 3 || !is_list(p[1]) || !is_list(p[2])) break;   // raises, or its names are free
+                    for (auto& param : boost::get<List>(p[1].data))
+                        if (param.kind == Kind::Name) bound.push_back(&boost::get<string>(param.data));
+                    names(boost::get<List>(p[2].data), bound, free);
+                    bound.resize(outer);
+                    p += 2;
+                    break;
+                case Kind::Let:         // (let ((name value)...) body...), the values see the names outside
+                    if (cells.end() - p < 3 || !is_list(p[1])) break;
+                    for (auto& pair : boost::get<List>(p[1].data))
+                        if (is_list(pair) && boost::get<List>(pair.data).size() >= 2) names(Span{boost::get<List>(pair.data)[1]}, bound, free);
+                    for (auto& pair : boost::get<List>(p[1].data))
+                        if (is_list(pair) && !boost::get<List>(pair.data).empty() && boost::get<List>(pair.data)[0].kind == Kind::Name)
+                            bound.push_back(&boost::get<string>(boost::get<List>(pair.data)[0].data));
+                    names({p + 2, cells.end()}, bound, free);
+                    bound.resize(outer);
+                    return;
+                default: break;
+            }
+        }
+    }
+
+    Profile& profile(Proc& proc) {
+        Profile* p = proc.profile.p.load(memory_order_acquire);
+        if (p) return *p;
+        Profile* made = new Profile();
+        if (proc.profile.p.compare_exchange_strong(p, made, memory_order_acq_rel)) return *made;
+        delete made;    // another thread was first
+        return *p;
+    }
+
+    bool pure(const Cell& c, vector<const Proc*>& visiting);
+
+    bool pure(Proc& proc, vector<const Proc*>& visiting) {
+        if (find(visiting.begin(), visiting.end(), &proc) != visiting.end()) return true;  // recursion adds no effect
+        Profile& p = profile(proc);
+        call_once(p.analyzed, [&] {
+            p.effects = effects(proc.body);
+            if (p.effects) return;
+            vector<const string*> bound;
+            for (auto& param : proc.params) if (param.kind == Kind::Name) bound.push_back(&boost::get<string>(param.data));
+            names(proc.body, bound, p.free);
+        });
+        if (p.effects) return false;
+        visiting.push_back(&proc);
+        for (auto name : p.free) {
+            const Cell* c = find(proc.env, *name);
+            if (!c || !pure(*c, visiting)) return false;   // unbound raises, which is left to the caller's thread
+        }
+        return true;
+    }
+
+    bool pure(const Cell& c, vector<const Proc*>& visiting) {
+        if (c.kind == Kind::Proc) return pure(*boost::get<Proc*>(c.data), visiting);
+        if (c.kind != Kind::Expr) return true;
+        for (auto& e : boost::get<List>(c.data)) if (!pure(e, visiting)) return false;
+        return true;
+    }
+
+    bool pure(Span cells, Env* env) {   // cells evaluated in env
+        if (effects(cells)) return false;
+        vector<const string*> bound, free;
+        names(cells, bound, free);
+        vector<const Proc*> visiting;
+        for (auto name : free) {
+            const Cell* c = find(env, *name);
+            if (!c || !pure(*c, visiting)) return false;
+        }
+        return true;
+    }
+
+    // cost model: the time a proc took on arguments of the same size, numbers by their magnitude,
+    // lists by their cells and f64vectors by their elements
+
+    size_t size(const Cell& c) {
+        constexpr size_t most = 1 << 20;
+        if (c.kind == Kind::Number) {
+            double d = fabs(boost::get<double>(c.data));
+            return d < most? size_t(d) : most;
+        }
+        if (c.kind == Kind::F64vector) return 1 + boost::get<F64vector>(c.data)->size();
+        if (c.kind != Kind::Expr) return 1;
+        size_t n = 1;
+        for (auto& e : boost::get<List>(c.data)) n += e.kind == Kind::Expr? size(e) : 1;
+        return n;
+    }
+
+    size_t bucket(Parser::Values args) {
+        size_t n = 0;
+        for (auto& a : args) n += size(a);
+        if (n < 64) return n;
+        size_t log = 0;
+        while (n >>= 1) ++log;
+        return min(Profile::buckets - 1, 64 + log - 6);
+    }
+
+    void record(Profile& p, size_t b, Clock::duration d) {
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(d).count();
+        uint64_t old = p.ns[b].load(memory_order_relaxed);
+        p.ns[b].store(p.runs[b].load(memory_order_relaxed)? (3 * old + ns) / 4 : ns, memory_order_relaxed);
+        p.runs[b].fetch_add(1, memory_order_relaxed);
+    }
+
+    bool sample(const Profile& p, size_t b) {   // time this call, every call at first then one in sample_every
+        constexpr unsigned sample_every = 16;
+        static thread_local unsigned calls {0};
+        return p.runs[b].load(memory_order_relaxed) < sample_every || ++calls % sample_every == 0;
+    }
+
+    bool costly(const Profile& p, size_t b) {   // never run yet is not
+        return p.runs[b].load(memory_order_relaxed) && p.ns[b].load(memory_order_relaxed) >= Parallel::min_cost_us * 1000;
+    }
+
+    bool holds_proc(const Cell& c) {
+        if (c.kind == Kind::Proc) return true;
+        if (c.kind != Kind::Expr) return false;
+        const List& l = boost::get<List>(c.data);
+        return any_of(l.begin(), l.end(), holds_proc);
+    }
+
+    struct Task {   // a call of a pure proc on evaluated arguments
+        const Cell* cell;   // the argument it is the value of
+        size_t slot;        // of the value, from the first argument's
+        size_t bucket;
+        Cell fn;
+        List args;
+        Cell result;
+        exception_ptr error;
+        bool done;  // guarded by the pool's mutex
+    };
+
+    void execute(Interpreter& interp, Task& t) {    // on whichever thread took it
+        auto start = Clock::now();
+        {
+            Parser::Unwind unwind {interp};
+            size_t base = interp.values.size();
+            interp.values.insert(interp.values.end(), t.args.begin(), t.args.end());
+            try { t.result = Compile::call(interp, t.fn, base); }
+            catch (...) { t.error = current_exception(); }
+        }
+        record(profile(*boost::get<Proc*>(t.fn.data)), t.bucket, Clock::now() - start);
+    }
+
+    // workers are only handed a task once reserved, so every queued task has a thread free to take
+    // it and a worker waiting on tasks it forked itself never waits on the queue
+    class Pool {
+    public:
+        explicit Pool(size_t n) : idle{long(n)} {
+            for (size_t i = 0; i < n; ++i) workers.emplace_back(&Pool::work, this);
+        }
+        ~Pool() {   // once nothing waits on a task, each worker finishes what is queued and returns
+            { lock_guard<mutex> lock {m}; stopping = true; }
+            ready.notify_all();
+            for (auto& w : workers) w.join();
+        }
+        bool reserve() {
+            long i = idle.load(memory_order_relaxed);
+            do if (i <= 0) return false;
+            while (!idle.compare_exchange_weak(i, i - 1, memory_order_relaxed));
+            return true;
+        }
+        void push(Task* t) {
+            { lock_guard<mutex> lock {m}; queue.push_back(t); }
+            ready.notify_one();
+        }
+        bool steal(Task* t) {   // true if no worker has taken t yet, which is then the caller's
+            {
+                lock_guard<mutex> lock {m};
+                auto p = find(queue.begin(), queue.end(), t);
+                if (p == queue.end()) return false;
+                queue.erase(p);
+            }
+            idle.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+        void wait(Task* t) {
+            unique_lock<mutex> lock {m};
+            finished.wait(lock, [t] { return t->done; });
+        }
+    private:
+        void work() {
+            Interpreter interp;     // its own heap, frames and value stack; procs it reads are the caller's
+            while (true) {
+                Task* t;
+                {
+                    unique_lock<mutex> lock {m};
+                    ready.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty()) return;
+                    t = queue.front();
+                    queue.pop_front();
+                }
+                execute(interp, *t);
+                interp.heap.end_region(t->result);
+                {
+                    lock_guard<mutex> lock {m};
+                    t->done = true;
+                }
+                finished.notify_all();
+                idle.fetch_add(1, memory_order_relaxed);
+            }
+        }
+
+        atomic<long> idle;
+        mutex m;
+        condition_variable ready, finished;
+        deque<Task*> queue;
+        bool stopping {false};
+        vector<thread> workers;     // last, started once the rest is there
+    };
+
+    // the process's pool, made on first use and joined as it exits. It is stopped before a fork, so
+    // the child holds no threads it does not have, and each side starts its own when it next forks
+    struct Owner {
+        mutex m;
+        unique_ptr<Pool> pool;
+        Owner();
+    };
+
+    Owner& owner() {
+        static Owner o;
+        return o;
+    }
+
+    Owner::Owner() {
+        pthread_atfork([] { owner().m.lock(); owner().pool.reset(); },
+                       [] { owner().m.unlock(); }, [] { owner().m.unlock(); });
+    }
+
+    Pool& pool() {
+        Owner& o = owner();
+        lock_guard<mutex> lock {o.m};
+        if (!o.pool) o.pool.reset(new Pool{Parallel::threads});
+        return *o.pool;
+    }
+
+    bool call(const Cell& c) {  // (name args...), which fork may take apart
+        if (c.kind != Kind::Expr) return false;
+        const List& l = boost::get<List>(c.data);
+        return !l.empty() && l[0].kind == Kind::Name;
+    }
+}
+
+bool Parallel::candidate(Span args) {
+    size_t calls = 0;
+    for (auto p = args.begin(); p != args.end(); ++p) {
+        switch (p->kind) {
+            case Kind::Number: case Kind::Name: break;
+            case Kind::Quote: if (++p == args.end()) return false; break;
+            case Kind::Expr: if (call(*p)) ++calls; break;
+            default: return false;  // keywords are read differently by evlist and arguments
+        }
+    }
+    return calls >= 2 && !effects(args);
+}
+
+Cell Parallel::Evaluator::value(Interpreter& interp, const Cell& expr, Env* env) const {
+    return Parser::eval(interp, Span{expr}, env);
+}
+
+void Parallel::Evaluator::arguments(Interpreter& interp, const Cell& call, Env* env) const {
+    const List& l = boost::get<List>(call.data);
+    Parser::arguments(interp, l.data(), l.data() + l.size(), env);
+}
+
+bool Parallel::fork(Interpreter& interp, Span args, Env* env, const Evaluator* by) {
+    static const Evaluator walker;
+    const Evaluator& evaluator = by? *by : walker;
+    if (!by && !candidate(args)) return false;     // checked once where it was compiled
+    const Cell* last_call {nullptr};    // evaluated on this thread, which would wait for the others otherwise
+    for (auto p = args.begin(); p != args.end(); ++p) {
+        if (p->kind == Kind::Quote) ++p;
+        else if (p->kind == Kind::Name) {   // evlist would call it on the rest
+            const Cell* c = find(env, boost::get<string>(p->data));
+            if (!c || c->kind == Kind::Proc) return false;
+        }
+        else if (call(*p)) last_call = p;
+    }
+    List& values = interp.values;
+    size_t base = values.size();
+    Roots roots {interp.heap};
+    roots.add(env);
+    Cell fn;        // proc of the call being evaluated
+    roots.add(&fn);
+    vector<unique_ptr<Task>> tasks;     // the pool holds pointers to them
+    int rest_pure {-1};     // of the arguments after the first costly call, once known
+    exception_ptr error;
+    size_t failed {0};      // slot of the argument that raised error
+    for (auto p = args.begin(); p != args.end(); ++p) {
+        size_t slot = values.size() - base;
+        try {
+            if (p->kind == Kind::Number) { values.push_back(*p); continue; }
+            if (p->kind == Kind::Quote) { values.push_back(*++p); continue; }
+            if (p->kind == Kind::Name) { values.push_back(env->lookup(boost::get<string>(p->data))); continue; }
+            const Cell* f = call(*p)? find(env, boost::get<string>(boost::get<List>(p->data)[0].data)) : nullptr;
+            if (!f || f->kind != Kind::Proc) { values.push_back(evaluator.value(interp, *p, env)); continue; }
+            fn = *f;
+            size_t at = values.size();
+            evaluator.arguments(interp, *p, env);
+            Proc& proc = *boost::get<Proc*>(fn.data);
+            Profile& prof = profile(proc);
+            size_t b = bucket({values.data() + at, values.data() + values.size()});
+            bool forking = p != last_call && costly(prof, b);
+            if (forking) {
+                if (rest_pure < 0) rest_pure = pure({p + 1, args.end()}, env);
+                vector<const Proc*> visiting;
+                forking = rest_pure && pure(fn, visiting)
+                    && all_of(values.begin() + at, values.end(), [&](const Cell& c) { return pure(c, visiting); });
+                if (!forking) impure.fetch_add(1, memory_order_relaxed);
+            }
+            if (forking && pool().reserve()) {
+                tasks.emplace_back(new Task{p, slot, b, fn, {values.begin() + at, values.end()}, {}, {}, false});
+                Task* t = tasks.back().get();
+                roots.add(&t->fn);
+                roots.add(&t->args);
+                values.erase(values.begin() + at, values.end());
+                values.push_back({});   // until the task is done
+                pool().push(t);
+                forked.fetch_add(1, memory_order_relaxed);
+                continue;
+            }
+            if (!sample(prof, b)) { values.push_back(Compile::call(interp, fn, at)); continue; }
+            auto start = Clock::now();
+            Cell res = Compile::call(interp, fn, at);
+            record(prof, b, Clock::now() - start);
+            values.push_back(std::move(res));
+        }
+        catch (...) {
+            error = current_exception();
+            failed = slot;
+            break;
+        }
+    }
+    for (auto t = tasks.rbegin(); t != tasks.rend(); ++t) {     // the frames they read must outlive them
+        if (pool().steal(t->get())) execute(interp, **t);
+        else pool().wait(t->get());
+    }
+    for (auto& t : tasks) {     // the first error in argument order, as evaluating them in order gives
+        if (error && t->slot > failed) break;
+        if (t->error) { error = t->error; break; }
+    }
+    if (error) {
+        values.erase(values.begin() + base, values.end());
+        rethrow_exception(error);
+    }
+    for (auto& t : tasks) {
+        if (holds_proc(t->result)) {    // made in the worker's heap
+            Cell v = evaluator.value(interp, *t->cell, env);
+            values[base + t->slot] = std::move(v);
+        }
+        else values[base + t->slot] = std::move(t->result);
+    }
+    return true;
+}
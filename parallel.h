@@ -0,0 +1,42 @@
+#ifndef clispp_parallel
+#define clispp_parallel
+#include <atomic>
+#include <memory>
+#include "parser_impl.h"
+
+// parallel evaluation of arguments, enabled by --parallel N: where the arguments of a primitive or
+// call hold two or more calls of named procs, each call whose proc took at least min_cost_us on
+// arguments of about the same size before is handed to one of N worker threads while the rest are
+// evaluated as usual. Only pure arguments are forked: nothing the calls or the other arguments can
+// reach defines, includes or reads (stats), so they read the same frames whatever the order. The
+// values are pushed in argument order and the first error in that order is raised, so results are
+// those of evaluating the arguments one after another; a call whose value holds a proc is taken
+// again on the caller's thread, procs made by a worker stay in its heap
+namespace Parallel {
+    extern std::atomic<size_t> forked;  // calls run by a worker, shown by (stats)
+    extern std::atomic<size_t> impure;  // costly calls left in order, as something the arguments reach is impure
+    extern size_t threads;      // set by --parallel, before any interpreter reads; 0 evaluates in order
+    extern double min_cost_us;  // a call worth handing to another thread
+
+    // costs of a proc's calls by the size of their arguments, and what its body refers to
+    struct Profile;
+
+    // how fork evaluates an argument it does not take apart, and the arguments of a call it does;
+    // by default as Parser::eval and Parser::arguments, the closure compiler gives its nodes
+    class Evaluator {
+    public:
+        virtual ~Evaluator() {}
+        virtual Lexer::Cell value(Environment::Interpreter& interp, const Lexer::Cell& expr, Environment::Env* env) const;
+        virtual void arguments(Environment::Interpreter& interp, const Lexer::Cell& call, Environment::Env* env) const;
+    };
+
+    // evaluates args, the cells after a proc name or primitive, onto interp.values as evlist and
+    // Parser's arguments both would, true once done; false, having evaluated nothing, where one of
+    // them can tell apart or fewer than two calls could run in parallel
+    bool fork(Environment::Interpreter& interp, Parser::Span args, Environment::Env* env, const Evaluator* by = nullptr);
+    inline bool arguments(Environment::Interpreter& interp, Parser::Span args, Environment::Env* env) {
+        return threads && fork(interp, args, env);
+    }
+    bool candidate(Parser::Span args);  // holds the calls fork looks for, so it may return true
+}
+#endif
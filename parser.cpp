@@ -1,8 +1,16 @@
 #include "parser_impl.h"
-#include "environment.h"
+#include "compile.h"
+#include "jit.h"
+#include "optimize.h"
+#include "memo.h"
+#include "parallel.h"
+#include "vector.h"
+#include "interpreter.h"
 #include "error.h"
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <iterator>
 
 using namespace std;
 using namespace Lexer;
@@ -13,16 +21,24 @@ const T& get(Iter p) {
     return boost::get<T>(p->data);
 }
 
-List Parser::expr(bool getfirst) {   // returns an unevaluated expression from stream
-    List res;
+List Parser::read(Interpreter& interp) {
+    interp.arena.reset();   // the previous form is done, whatever it kept was copied out of the arena
+    List form = expr(interp, true);
+    Optimize::form(form);
+    return form;
+}
+
+List Parser::expr(Interpreter& interp, bool getfirst) {   // returns an unevaluated expression from stream
+    Cell_stream& cs = interp.cs;
+    List res {&interp.arena};
     while (getfirst && cs.get().kind == Kind::Comment) cs.ignoreln();   // eat either first ( or ;
     if (cs.current().kind != Kind::Lp) {    // not a call, doesn't start with (
         if (cs.current().kind == Kind::End) return res;
         res.push_back(cs.current()); 
         if (cs.current().kind == Kind::Quote) {
-            List quote(expr(true));
-            if (quote.size() == 1) res.push_back(quote[0]); 
-            else res.push_back(quote); 
+            List quote(expr(interp, true));
+            if (quote.size() == 1) res.push_back(std::move(quote[0])); 
+            else res.push_back(std::move(quote)); 
         }
         return res;   
     } 
@@ -31,7 +47,7 @@ List Parser::expr(bool getfirst) {   // returns an unevaluated expression from s
         cs.get();
         switch (cs.current().kind) {
             case Kind::Lp: {    // start of another expression
-                res.push_back(expr(false));  // construct with List, kind is expr and data stored in lstval
+                res.push_back(expr(interp, false));  // construct with List, kind is expr and data stored in lstval
                 // after geting in an ( expression ' ' <-- expecting rp
                 if (cs.current().kind != Kind::Rp) throw runtime_error("')' expected");
                 break;
@@ -44,234 +60,504 @@ List Parser::expr(bool getfirst) {   // returns an unevaluated expression from s
     }
 }
 
-Cell Parser::eval(const List& expr, Env* env) {
-    for (auto p = expr.begin(); p != expr.end(); ++p) {
+namespace {
+    using Parser::Unwind;
+    using Parser::collapse;
+    using Parser::access;
+
+    // (car x), (cdr x) and (empty? x) of a variable read its list in place rather than copying all of it
+    const Cell* variable(const Cell& prim, Parser::Span args, Env* env) {
+        if (!Parser::accessor(prim) || args.size() != 1 || args[0].kind != Kind::Name) return nullptr;
+        const Cell& x = env->lookup(get<string>(args.begin()));
+        return x.kind == Kind::Proc? nullptr : &x;     // a proc is called instead
+    }
+}
+
+// evaluates the arguments following the proc name at p onto the value stack
+void Parser::arguments(Interpreter& interp, const Cell* p, const Cell* last, Env* env) {
+    if (Parallel::arguments(interp, {p + 1, last}, env)) return;
+    List& values = interp.values;
+    while (++p != last) {  // evaluate as many arguments locally as possible
+        if (p->kind == Kind::Number) values.push_back(*p);
+        else if (p->kind == Kind::Quote) values.push_back(*++p);
+        else if (p->kind == Kind::Name) values.push_back(env->lookup(get<string>(p)));
+        else {
+            evlist(interp, {p, last}, env); // evlist any remaining expressions
+            break;
+        }
+    }
+}
+
+// the values evlist pushed from base on as one cell, a single value or the list of them
+void Parser::collapse(List& values, size_t base) {
+    if (values.size() - base == 1) return;
+    List list {make_move_iterator(values.begin() + base), make_move_iterator(values.end())};
+    values.erase(values.begin() + base, values.end());
+    values.push_back({std::move(list)});
+}
+
+bool Parser::accessor(const Cell& prim) {
+    return prim.kind == Kind::Car || prim.kind == Kind::Cdr || prim.kind == Kind::Empty;
+}
+
+Cell Parser::access(const Cell& prim, const Cell& arg) {
+    if (prim.kind == Kind::Empty) return Cell{arg.kind == Kind::Expr && get<List>(&arg).empty()};
+    if (arg.kind != Kind::Expr) return prim.kind == Kind::Car? arg : Cell{List{}};
+    const List& list = get<List>(&arg);
+    if (prim.kind == Kind::Car) return list[0];
+    if (list.size() == 1) return {List{}};
+    else if (list.size() == 2) return list[1];
+    return {List{list.begin() + 1, list.end()}};
+}
+
+Cell Parser::eval(Interpreter& interp, const List& expr, Env* env) {
+    if (interp.mode == Interpreter::Mode::Closures) return Compile::run_form(interp, expr, env);
+    return eval(interp, Span{expr}, env);
+}
+
+// loops instead of recursing for calls, cond clauses, let and begin bodies in tail position, so a
+// tail recursive proc runs in constant C++ stack and reuses one frame
+Cell Parser::eval(Interpreter& interp, Span expr, Env* env) {
+    List& values = interp.values;
+    Unwind unwind {interp};
+    Roots roots {interp.heap};  // env and the frames lets in tail position entered since the last call
+    Cell fn;    // proc being tail called, owns the body being evaluated
+    roots.add(&fn);
+    roots.add(env);
+    while (true) {
+        if (expr.empty()) return {};
+        auto p = expr.begin();
         switch (p->kind) {
             case Kind::Include: 
-                cs.set_input(new ifstream{get<string>(++p)}); 
+                interp.cs.include(get<string>(++p));
                 return {Kind::Include};
+            case Kind::Stats: return {interp.stats()};
             case Kind::Number: return *p;
             // return next expression unevaluated, (quote expr)
             case Kind::Quote: 
                 if (p + 1 == expr.end()) throw runtime_error("Quote expects 1 arg");
                 return *++p;  
-            case Kind::Begin:       // (begin a b c d ... return)
-                evlist({++p, expr.end() - 1}, env);
-                return eval({expr.back()}, env);    
+            case Kind::Begin: {     // (begin a b c d ... return)
+                if (p + 1 == expr.end()) throw runtime_error("Begin expects at least one expression");
+                size_t base = values.size();
+                evlist(interp, {p + 1, expr.end() - 1}, env);
+                values.erase(values.begin() + base, values.end());
+                expr = Span{expr.back()};
+                continue;
+            }
             case Kind::Lambda: {    // (lambda (params) (body))
                 if (p + 2 >= expr.end()) throw runtime_error("Malformed lambda expression");
-                auto params = get<List>(++p);
-                auto body = get<List>(++p);
-                procs.push_back({params, body, env});    // introduce onto heap
-                return {&procs.back()};
+                const List& params = get<List>(++p);
+                const List& body = get<List>(++p);
+                return {closure(interp, params, body, env)};    // introduce onto heap
             }
-            // introduce cell to environment (define name expr)
-            case Kind::Define: {
+            // introduce cell to environment (define name expr), define-memo only takes the proc form
+            case Kind::Define: case Kind::Memo: {
                 if (p + 2 >= expr.end()) throw runtime_error("Malformed define expression");
+                bool memo = p->kind == Kind::Memo;
                 auto np = ++p;    // cell to be defined
-                if (np->kind == Kind::Name) 
-                    return (*env)[get<string>(np)] = eval({++p, expr.end()}, env); 
+                if (np->kind == Kind::Name && !memo) {
+                    Cell value = eval(interp, Span{p + 1, expr.end()}, env);
+                    (*env)[get<string>(np)] = value;
+                    interp.heap.barrier(env);
+                    return value;
+                }
                 else if (np->kind == Kind::Expr) {   // (syntactic sugar for defining functions (define (func args) (body))
-                    auto declaration = get<List>(np);
-                    string name = get<string>(declaration.begin());
-                    auto params = List{declaration.begin() + 1, declaration.end()};
-                    auto body = get<List>(++p);
-                    procs.push_back({params, body, env});
-                    return (*env)[name] = {&procs.back()};
+                    const List& declaration = get<List>(np);
+                    const string& name = get<string>(declaration.begin());
+                    List params {declaration.begin() + 1, declaration.end()};
+                    const List& body = get<List>(++p);
+                    Proc* made = closure(interp, params, body, env);
+                    if (memo) Memo::attach(*made, Memo::capacity({p + 1, expr.end()}));
+                    Cell proc {made};
+                    (*env)[name] = proc;
+                    interp.heap.barrier(env);
+                    return proc;
                 }
                 else throw runtime_error("Unfamiliar form to define");
             }
             // (... (expr) ...) parentheses encloses expression (as parsed by expr())
             case Kind::Expr: { 
-                auto res = evlist(get<List>(p), env); 
-                if (res.size() == 1) return {res[0]}; // single element
-                return {res};
+                const List& list = get<List>(p);
+                if (!list.empty() && list[0].kind == Kind::Name) {  // (proc args...) evaluates to the call, a tail call
+                    Cell x = env->lookup(get<string>(list.begin()));
+                    if (x.kind == Kind::Proc) {
+                        size_t base = values.size();
+                        arguments(interp, &list[0], Span{list}.end(), env);
+                        Cell res;
+                        if (Memo::run(interp, x, base, res) || Jit::run(interp, x, base, res)) return res;
+                        unwind.frames_only();   // nothing refers to the frames of this evaluation any more
+                        fn = std::move(x);
+                        roots.clear();
+                        roots.add(&fn);
+                        env = enter(interp, fn, base);
+                        roots.add(env);
+                        expr = Span{boost::get<Proc*>(fn.data)->body};
+                        continue;
+                    }
+                }
+                // (begin ...) and (let ...) evaluate to their last form as they do unenclosed
+                if (!list.empty() && (list[0].kind == Kind::Begin || list[0].kind == Kind::Let)) {
+                    expr = Span{list};
+                    continue;
+                }
+                size_t base = values.size();
+                // (cond ...) evaluates to the matching clause when it is the last one, otherwise evlist
+                // goes on with the clauses after it
+                if (!list.empty() && list[0].kind == Kind::Cond) {
+                    Span clauses {list};
+                    bool tail = false, matched = false;
+                    for (auto q = clauses.begin() + 1; q != clauses.end(); ++q) {
+                        const List& clause = get<List>(q);
+                        bool last = q + 1 == clauses.end();
+                        if (clause[0].kind == Kind::Else) {
+                            if (!last) throw runtime_error("Else clause not at end of condition");
+                        }
+                        else if (!eval(interp, Span{clause[0]}, env)) continue;
+                        matched = true;
+                        if (last) {
+                            expr = Span{clause[1]};
+                            tail = true;
+                            break;
+                        }
+                        values.push_back(eval(interp, Span{clause[1]}, env));
+                        evlist(interp, {q + 1, clauses.end()}, env);
+                        break;
+                    }
+                    if (!matched) throw runtime_error("No cond clause matched");
+                    if (tail) continue;
+                    collapse(values, base);
+                    Cell res {std::move(values.back())};
+                    values.pop_back();
+                    return res;
+                }
+                evlist(interp, list, env);
+                collapse(values, base);
+                Cell res {std::move(values.back())};
+                values.pop_back();
+                return res;
             }
             // (let (definitions...) body) block structure
             case Kind::Let: {
                 if (p + 2 >= expr.end()) throw runtime_error("Let expects a list of definitions and a body");
-                auto localvars = get<List>(++p); // ((name val) (name val) ...)
-                Env localenv {env};
-                for (auto& pair : localvars)    // add to local env
-                    localenv[boost::get<string>((boost::get<List>(pair.data)[0]).data)] = eval({boost::get<List>(pair.data)[1]}, env);
-                // evaluate rest of expression inside new env
-                if ((++p)->kind == Kind::Expr) {
-                    auto body = get<List>(p);
-                    return eval(body, &localenv);   // local env is temporary, no need to allocate on heap
+                const List& localvars = get<List>(++p); // ((name val) (name val) ...)
+                // closures made in the body outlive the let, otherwise the frame is temporary
+                bool escapes = captures({p + 1, expr.end()});
+                Env* localenv = escapes? interp.heap.make_env(env) : interp.stack.push(env);
+                roots.add(localenv);    // env stays a root too, the collector does not follow outer off the heap
+                for (auto& pair : localvars) {  // add to local env
+                    const List& def = boost::get<List>(pair.data);
+                    Cell value = eval(interp, Span{def[1]}, env);
+                    if (escapes) {
+                        (*localenv)[boost::get<string>(def[0].data)] = std::move(value);
+                        interp.heap.barrier(localenv);
+                    }
+                    else localenv->bind(boost::get<string>(def[0].data), std::move(value));
                 }
-                return eval({*p}, &localenv);   
+                if (escapes && !defines({p + 1, expr.end()})) localenv->seal();
+                // evaluate rest of expression inside new env
+                env = localenv;
+                if ((++p)->kind == Kind::Expr) expr = Span{get<List>(p)};
+                else expr = Span{*p};
+                continue;
             }
             // (cond ((pred) (expr)) ((pred) (expr)) ...(else expr)) expect list of pred-expr pairs
             case Kind::Cond: {
-                while (++p != expr.end()) {
+                bool matched = false;
+                while (!matched && ++p != expr.end()) {
                     const List& clause = get<List>(p);
                     if (clause[0].kind == Kind::Else) {
-                        if (p + 1 == expr.end()) return eval({clause[1]}, env);
-                        else throw runtime_error("Else clause not at end of condition");
+                        if (p + 1 != expr.end()) throw runtime_error("Else clause not at end of condition");
+                        expr = Span{clause[1]};
+                        matched = true;
+                    }
+                    else if (eval(interp, Span{clause[0]}, env)) {
+                        expr = Span{&clause[0] + 1, Span{clause}.end()};
+                        matched = true;
                     }
-                    if (eval({clause[0]}, env)) return eval({clause.begin() + 1, clause.end()}, env);
                 }
+                if (!matched) throw runtime_error("No cond clause matched");
+                continue;
+            }
+            // (memoize proc [capacity]) a copy of proc remembering its results
+            case Kind::Memoize: {
+                size_t base = values.size();
+                arguments(interp, p, expr.end(), env);  // as a call's, so the proc named is not called
+                return Memo::memoize(interp, {values.data() + base, values.data() + values.size()});
             }
             // primitive procedures
             case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal: 
             case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not: 
-            case Kind::Empty: {
+            case Kind::Empty:
+            case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+            case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max: {
                 if (p + 1 == expr.end()) throw runtime_error("Primitives take at least one argument");
-                auto prim = *p;
-                return apply_prim(prim, evlist({++p, expr.end()}, env));
+                if (auto x = variable(*p, {p + 1, expr.end()}, env)) return access(*p, *x);
+                size_t base = values.size();
+                if (!Parallel::arguments(interp, {p + 1, expr.end()}, env)) evlist(interp, {p + 1, expr.end()}, env);
+                return apply_prim(*p, {values.data() + base, values.data() + values.size()});
             }
             case Kind::Name: {  // lexer cannot distinguish between varname and procname, have to evaluate against environment
                 Cell x = env->lookup(get<string>(p));
                 if (x.kind != Kind::Proc) return x;
-                List args;  // user defined proc
-                while (++p != expr.end()) {  // evaluate as many arguments locally as possible
-                    if (p->kind == Kind::Number) args.push_back(*p);
-                    else if (p->kind == Kind::Quote) args.push_back(*++p);
-                    else if (p->kind == Kind::Name) args.push_back(env->lookup(get<string>(p)));
-                    else {
-                        List addargs = evlist({p, expr.end()}, env); // evlist any remaining expressions
-                        args.insert(args.end(), addargs.begin(), addargs.end());
-                        break;
-                    }
-                }
-                return apply(x, args);    
+                size_t base = values.size();    // user defined proc, called in tail position
+                arguments(interp, p, expr.end(), env);
+                Cell res;
+                if (Memo::run(interp, x, base, res) || Jit::run(interp, x, base, res)) return res;
+                unwind.frames_only();
+                fn = std::move(x);
+                roots.clear();
+                roots.add(&fn);
+                env = enter(interp, fn, base);
+                roots.add(env);
+                expr = Span{boost::get<Proc*>(fn.data)->body};
+                continue;
             }
             default: throw runtime_error("Unmatched cell in eval");
         }
     }
-    return {};
 }
 
-List Parser::evlist(const List& expr, Env* env) {
-    List res;   // instead of returning right away, push back into res then return res
+void Parser::evlist(Interpreter& interp, Span expr, Env* env) {     // pushes the values onto interp.values
+    List& values = interp.values;
+    size_t start = values.size();
+    Roots roots {interp.heap};
+    roots.add(env);
     for (auto p = expr.begin(); p != expr.end(); ++p) {
         switch (p->kind) {
             case Kind::Include: 
-                cs.set_input(new ifstream{get<string>(++p)}); 
-                return {Kind::Include};
-            case Kind::Number: res.push_back(*p); break;
+                interp.cs.include(get<string>(++p));
+                values.erase(values.begin() + start, values.end());
+                values.push_back({Kind::Include});
+                return;
+            case Kind::Stats: values.push_back({interp.stats()}); break;
+            case Kind::Number: values.push_back(*p); break;
             // return next expression unevaluated, (quote expr)
             case Kind::Quote: 
                 if (p + 1 == expr.end()) throw runtime_error("Quote expects 1 arg");
-                res.push_back(*++p); break;  
-            case Kind::Begin:       // (begin a b c d ... return)
-                evlist({++p, expr.end() - 1}, env);
-                res.push_back(eval({expr.back()}, env));
-                return res;
+                values.push_back(*++p); break;  
+            case Kind::Begin: {     // (begin a b c d ... return)
+                if (p + 1 == expr.end()) throw runtime_error("Begin expects at least one expression");
+                size_t base = values.size();
+                evlist(interp, {p + 1, expr.end() - 1}, env);
+                values.erase(values.begin() + base, values.end());
+                values.push_back(eval(interp, Span{expr.back()}, env));
+                return;
+            }
             case Kind::Lambda: {    // (lambda (params) (body))
                 if (p + 2 >= expr.end()) throw runtime_error("Malformed lambda expression");
-                auto params = get<List>(++p);
-                auto body = get<List>(++p);
-                procs.push_back({params, body, env});    // introduce onto heap
-                res.push_back({&procs.back()});
+                const List& params = get<List>(++p);
+                const List& body = get<List>(++p);
+                values.push_back({closure(interp, params, body, env)});    // introduce onto heap
                 break;
             }
-            // introduce cell to environment (define name expr)
-            case Kind::Define: {
+            // introduce cell to environment (define name expr), define-memo only takes the proc form
+            case Kind::Define: case Kind::Memo: {
                 if (p + 2 >= expr.end()) throw runtime_error("Malformed define expression");
+                bool memo = p->kind == Kind::Memo;
                 auto np = ++p;    // cell to be defined
-                if (np->kind == Kind::Name) {
-                    res.push_back((*env)[get<string>(np)] = eval({++p, expr.end()}, env)); 
-                    return res;
+                if (np->kind == Kind::Name && !memo) {
+                    Cell value = eval(interp, Span{p + 1, expr.end()}, env);
+                    (*env)[get<string>(np)] = value;
+                    interp.heap.barrier(env);
+                    values.push_back(std::move(value));
+                    return;
                 }
                 else if (np->kind == Kind::Expr) {   // (syntactic sugar for defining functions (define (func args) (body))
-                    auto declaration = get<List>(np);
-                    string name = get<string>(declaration.begin());
-                    auto params = List{declaration.begin() + 1, declaration.end()};
-                    auto body = get<List>(++p);
-                    procs.push_back({params, body, env});
-                    res.push_back((*env)[name] = {&procs.back()});
-                    return res;
+                    const List& declaration = get<List>(np);
+                    const string& name = get<string>(declaration.begin());
+                    List params {declaration.begin() + 1, declaration.end()};
+                    const List& body = get<List>(++p);
+                    Proc* made = closure(interp, params, body, env);
+                    if (memo) Memo::attach(*made, Memo::capacity({p + 1, expr.end()}));
+                    Cell proc {made};
+                    (*env)[name] = proc;
+                    interp.heap.barrier(env);
+                    values.push_back(std::move(proc));
+                    return;
                 }
                 else throw runtime_error("Unfamiliar form to define");
             }
             // (... (expr) ...) parentheses encloses expression (as parsed by expr())
             case Kind::Expr: {
-                auto r = evlist(get<List>(p), env); 
-                if (r.size() == 1) res.push_back({r[0]}); // single element result
-                else res.push_back({r});
+                size_t base = values.size();
+                evlist(interp, get<List>(p), env); 
+                collapse(values, base);     // single element result
                 break;
             }
             // (let (definitions...) body) block structure
             case Kind::Let: {
                 if (p + 2 >= expr.end()) throw runtime_error("Let expects a list of definitions and a body");
-                auto localvars = get<List>(++p); // ((name val) (name val) ...)
-                Env localenv {env};
-                for (auto& pair : localvars) // add to local env
-                    localenv[boost::get<string>((boost::get<List>(pair.data)[0]).data)] = eval({boost::get<List>(pair.data)[1]}, env);
-                // evaluate rest of expression inside new env
-                if ((++p)->kind == Kind::Expr) {
-                    auto body = get<List>(p);
-                    res.push_back(eval(body, &localenv));   
+                const List& localvars = get<List>(++p); // ((name val) (name val) ...)
+                bool escapes = captures({p + 1, expr.end()});
+                Frame_mark mark {interp.stack};
+                Env* localenv = escapes? interp.heap.make_env(env) : interp.stack.push(env);
+                roots.add(localenv);
+                for (auto& pair : localvars) {  // add to local env
+                    const List& def = boost::get<List>(pair.data);
+                    Cell value = eval(interp, Span{def[1]}, env);
+                    if (escapes) {
+                        (*localenv)[boost::get<string>(def[0].data)] = std::move(value);
+                        interp.heap.barrier(localenv);
+                    }
+                    else localenv->bind(boost::get<string>(def[0].data), std::move(value));
                 }
-                else res.push_back(eval({*p}, &localenv));
-                return res;   
+                if (escapes && !defines({p + 1, expr.end()})) localenv->seal();
+                // evaluate rest of expression inside new env
+                if ((++p)->kind == Kind::Expr) values.push_back(eval(interp, Span{get<List>(p)}, localenv));   
+                else values.push_back(eval(interp, Span{*p}, localenv));
+                return;   
             }
             // (cond ((pred) (expr)) ((pred) (expr)) ...) expect list of pred-expr pairs
             case Kind::Cond: {
                 while (++p != expr.end()) {
                     const List& clause = get<List>(p);
                     if (clause[0].kind == Kind::Else) {
-                        if (p + 1 == expr.end()) { res.push_back(eval({clause[1]}, env)); return res; }
+                        if (p + 1 == expr.end()) { values.push_back(eval(interp, Span{clause[1]}, env)); return; }
                         else throw runtime_error("Else clause not at end of condition");
                     }
-                    if (eval({clause[0]}, env)) { res.push_back(eval({clause[1]}, env)); break; }
+                    if (eval(interp, Span{clause[0]}, env)) { values.push_back(eval(interp, Span{clause[1]}, env)); break; }
                 }
+                if (p == expr.end()) throw runtime_error("No cond clause matched");
                 break;
             }
+            // (memoize proc [capacity]) a copy of proc remembering its results
+            case Kind::Memoize: {
+                size_t base = values.size();
+                arguments(interp, p, expr.end(), env);  // as a call's, so the proc named is not called
+                Cell res = Memo::memoize(interp, {values.data() + base, values.data() + values.size()});
+                values.erase(values.begin() + base, values.end());
+                values.push_back(std::move(res));
+                return;
+            }
             // primitive procedures
             case Kind::Add: case Kind::Sub: case Kind::Mul: case Kind::Div: case Kind::Less: case Kind::Greater: case Kind::Equal: 
             case Kind::Cat: case Kind::Cons: case Kind::Car: case Kind::Cdr: case Kind::List: case Kind::And: case Kind::Or: case Kind::Not:
-            case Kind::Empty: {
+            case Kind::Empty:
+            case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+            case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max: {
                 if (p + 1 == expr.end()) throw runtime_error("Primitives take at least one argument");
-                auto prim = *p;
-                res.push_back(apply_prim(prim, evlist({++p, expr.end()}, env)));
-                return res; // finished reading entire expression
+                if (auto x = variable(*p, {p + 1, expr.end()}, env)) { values.push_back(access(*p, *x)); return; }
+                size_t base = values.size();
+                if (!Parallel::arguments(interp, {p + 1, expr.end()}, env)) evlist(interp, {p + 1, expr.end()}, env);
+                Cell res = apply_prim(*p, {values.data() + base, values.data() + values.size()});
+                values.erase(values.begin() + base, values.end());
+                values.push_back(std::move(res));
+                return; // finished reading entire expression
             }
             case Kind::Name: {  // lexer cannot distinguish between varname and procname, have to evaluate against environment
                 Cell x = env->lookup(get<string>(p));
-                if (x.kind != Kind::Proc) { res.push_back(x); break; }
-                List args;
-                while (++p != expr.end()) {  // evaluate as many arguments locally as possible
-                    if (p->kind == Kind::Number) args.push_back(*p);
-                    else if (p->kind == Kind::Quote) args.push_back(*++p);
-                    else if (p->kind == Kind::Name) args.push_back(env->lookup(get<string>(p)));
-                    else {
-                        List addargs = evlist({p, expr.end()}, env); // evlist any remaining expressions
-                        args.insert(args.end(), addargs.begin(), addargs.end());
-                        break;
-                    }
-                }
-                res.push_back(apply(x, args)); return res;         // user defined proc
+                if (x.kind != Kind::Proc) { values.push_back(std::move(x)); break; }
+                roots.add(&x);
+                size_t base = values.size();
+                arguments(interp, p, expr.end(), env);
+                Cell res = call(interp, x, base);   // user defined proc
+                values.push_back(std::move(res));
+                return;
             }
             default: throw runtime_error("Unmatched in evlist"); 
         }
     }
-    return res;
 }
 
-Cell Parser::apply(const Cell& c, const List& args) {  // expect fully evaluated args
-    const Proc& proc = *boost::get<Proc*>(c.data);
-    Env* newenv = Parser::bind(proc.params, args, proc.env);
-    return eval(proc.body, newenv);
+Cell Parser::apply(Interpreter& interp, const Cell& proc, const List& args) {  // expect fully evaluated args
+    size_t base = interp.values.size();
+    interp.values.insert(interp.values.end(), args.begin(), args.end());
+    return Compile::call(interp, proc, base);     // the tree walker's call for procs without compiled code
 }
 
-Env* Parser::bind(const List& params, const List& args, Env* env) {
-    Env newenv {env};
-    if (params.size() != args.size()) { 
-        stringstream msg; msg << "provided args : " << args.size() << " expected: " << params.size();
+Cell Parser::call(Interpreter& interp, const Cell& proc, size_t args) {
+    Cell res;
+    if (Memo::run(interp, proc, args, res) || Jit::run(interp, proc, args, res)) return res;
+    Frame_mark mark {interp.stack};
+    Env* frame = enter(interp, proc, args);
+    return eval(interp, Span{boost::get<Proc*>(proc.data)->body}, frame);
+}
+
+// a frame for proc with the arguments moved off the value stack, on the heap only if the body makes closures
+Env* Parser::enter(Interpreter& interp, const Cell& c, size_t args) {
+    const Proc& proc = *boost::get<Proc*>(c.data);
+    List& values = interp.values;
+    if (proc.params.size() != values.size() - args) { 
+        stringstream msg; msg << "provided args : " << values.size() - args << " expected: " << proc.params.size();
         throw runtime_error(msg.str());
     }
-    auto q = args.begin();
-    for (auto p = params.begin(); p != params.end(); ++p, ++q)
-        newenv[get<string>(p)] = *q;
+    Env* frame;
+    if (proc.captures) {
+        frame = interp.heap.make_env(proc.env);
+        auto q = values.begin() + args;
+        if (proc.defines || proc.params.size() > Env::fixed_slots)    // general frame, defines go in the map
+            for (auto p = proc.params.begin(); p != proc.params.end(); ++p, ++q)
+                (*frame)[get<string>(p)] = std::move(*q);
+        else {
+            for (auto p = proc.params.begin(); p != proc.params.end(); ++p, ++q)
+                frame->bind(boost::get<Proc*>(c.data), get<string>(p), std::move(*q));
+            frame->seal();
+        }
+    }
+    else {
+        frame = interp.stack.push(proc.env);  // nothing can point into the frame once the call returns
+        auto q = values.begin() + args;
+        for (auto p = proc.params.begin(); p != proc.params.end(); ++p, ++q)
+            frame->bind(get<string>(p), std::move(*q));
+    }
+    values.erase(values.begin() + args, values.end());
+    return frame;
+}
+
+// conservative escape analysis: a frame can only be pointed to by procs made while evaluating in it
+bool Parser::captures(Span body) {
+    for (auto& cell : body) {
+        if (cell.kind == Kind::Lambda || cell.kind == Kind::Define || cell.kind == Kind::Memo) return true;
+        if (cell.kind == Kind::Expr && captures(boost::get<List>(cell.data))) return true;
+    }
+    return false;
+}
 
-    envs.push_back(newenv);  // store on the heap to allow reference and pointer
-    return &envs.back();
+bool Parser::defines(Span body) {
+    for (auto& cell : body) {
+        if (cell.kind == Kind::Define || cell.kind == Kind::Memo) return true;
+        if (cell.kind == Kind::Expr && defines(boost::get<List>(cell.data))) return true;
+    }
+    return false;
+}
+
+static void free_names(const List& body, const List& params, vector<string>& names) {   // superset, ignores shadowing
+    for (auto& cell : body) {
+        if (cell.kind == Kind::Expr) free_names(boost::get<List>(cell.data), params, names);
+        else if (cell.kind == Kind::Name) {
+            auto& name = boost::get<string>(cell.data);
+            if (find(names.begin(), names.end(), name) == names.end()
+                    && find_if(params.begin(), params.end(), [&](const Cell& p) { return boost::get<string>(p.data) == name; }) == params.end())
+                names.push_back(name);
+        }
+    }
+}
+
+// flat closure: copies the free variables bound in sealed frames, which never change again, into one
+// frame on top of the first frame that can, so lookups skip the chain and the sealed frames can die
+Proc* Parser::closure(Interpreter& interp, const List& params, const List& body, Env* env) {
+    Roots roots {interp.heap};
+    Env* top = env;
+    while (top->is_sealed()) top = top->parent();
+    if (top != env) {
+        vector<string> names;
+        free_names(body, params, names);
+        Env* flat = interp.heap.make_env(top);
+        roots.add(flat);
+        for (auto& name : names)
+            for (Env* f = env; f != top; f = f->parent())
+                if (auto value = f->local(name)) { (*flat)[name] = *value; break; }
+        flat->seal();
+        env = flat;
+    }
+    return interp.heap.make_proc(params, body, env, captures(body), defines(body));
 }
 
 // primitive procedures
-Cell Parser::apply_prim(const Cell& prim, const List& args) {
+Cell Parser::apply_prim(const Cell& prim, Values args) {
+    bool arithmetic = prim.kind == Kind::Add || prim.kind == Kind::Sub || prim.kind == Kind::Mul || prim.kind == Kind::Div;
+    if (arithmetic && Vector::holds(args)) return Vector::arithmetic(prim, args);   // element by element
     switch (prim.kind) {
         case Kind::Add: {   // more efficient to separate addition and concatenation
             double res {get<double>(args.begin())};
@@ -334,24 +620,31 @@ Cell Parser::apply_prim(const Cell& prim, const List& args) {
             return Cell{Kind::False};
         }
         case Kind::Not: return Cell{args[0].kind == Kind::False? Kind::True : Kind::False};  // only expect 1 argument
-        case Kind::List: return args;
+        case Kind::List: return List{make_move_iterator(args.begin()), make_move_iterator(args.end())};
         case Kind::Cons: {
-			List res {args[0]};
-			if (args[1].kind == Kind::Expr) res.insert(res.end(), boost::get<List>(args[1].data).begin(), boost::get<List>(args[1].data).end());
-			else res.push_back(args[1]);
-			return res; // return List of the 
+			List res;
+			res.push_back(std::move(args[0]));
+			if (args[1].kind == Kind::Expr) {
+				List& tail = boost::get<List>(args[1].data);
+				res.insert(res.end(), make_move_iterator(tail.begin()), make_move_iterator(tail.end()));
+			}
+			else res.push_back(std::move(args[1]));
+			return std::move(res); // return List of the 
 		}
         case Kind::Car: {
-            if (args[0].kind != Kind::Expr) return args[0];
-            return boost::get<List>(args[0].data)[0]; // args is a list of one cell which holds a list itself
+            if (args[0].kind != Kind::Expr) return std::move(args[0]);
+            return std::move(boost::get<List>(args[0].data)[0]); // args is a list of one cell which holds a list itself
         }
         case Kind::Cdr: { 
             if (args[0].kind != Kind::Expr) return {List {}};
-            auto list = boost::get<List>(args[0].data); 
+            List& list = boost::get<List>(args[0].data); 
             if (list.size() == 1) return {List {}};
-            else if (list.size() == 2) return list[1];
-            return {List{list.begin() + 1, list.end()}}; 
+            else if (list.size() == 2) return std::move(list[1]);
+            return {List{make_move_iterator(list.begin() + 1), make_move_iterator(list.end())}}; 
         }
+        case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+        case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max:
+            return Vector::apply(prim, args);
         default: throw runtime_error("Mismatoh in apply_prim");
     }
 }
@@ -1,13 +1,14 @@
 #ifndef lispcpp_parser
 #define lispcpp_parser
 #include "lexer.h"
-#include "environment.h"
+#include "interpreter.h"
 namespace Parser {
     using namespace Lexer;
     using namespace Environment;
 
-    List expr(bool getfirst);    // parses an expression without evaluating it, returning it as the lstval inside a cell
-    Cell eval(const List& expr, Env* env);     // delayed evaluation of expression given back by expr()
-    Cell apply(const Cell& proc, const List& args);           // applies a procedure to return a value
+    List read(Interpreter& interp);     // parses and optimizes the next top-level form, which lives in interp's arena until the next read
+    List expr(Interpreter& interp, bool getfirst);    // parses an expression without evaluating it, returning it as the lstval inside a cell
+    Cell eval(Interpreter& interp, const List& expr, Env* env);     // delayed evaluation of expression given back by expr()
+    Cell apply(Interpreter& interp, const Cell& proc, const List& args);           // applies a procedure to return a value
 }
 #endif
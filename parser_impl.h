@@ -1,10 +1,56 @@
 #ifndef bc_parser_impl
 #define bc_parser_impl
+#include <type_traits>
 #include "parser.h"
 
 namespace Parser {  // implementation interface
-    List evlist(const List& expr, Env* env);
-    Env* bind(const List& params, const List& args, Env* env);
-    Cell apply_prim(const Cell& prim, const List& args);
+    // cells of a List or part of one, never copied
+    template <typename T>
+    class Basic_span {
+        using Base = typename conditional<is_const<T>::value, const List, List>::type;
+    public:
+        Basic_span(T* f, T* l) : first{f}, last{l} {}
+        Basic_span(Base& l) : first{l.data()}, last{l.data() + l.size()} {}
+        explicit Basic_span(T& c) : first{&c}, last{&c + 1} {}
+        T* begin() const { return first; }
+        T* end() const { return last; }
+        T& operator[](size_t i) const { return first[i]; }
+        T& back() const { return last[-1]; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    private:
+        T* first;
+        T* last;
+    };
+    using Span = Basic_span<const Cell>;    // an expression being evaluated
+    using Values = Basic_span<Cell>;        // evaluated arguments, for the taking
+
+    // drops what an evaluation left on the value stack and pops the frames it pushed, when it returns or throws
+    class Unwind {
+    public:
+        Unwind(Interpreter& i) : interp(i), frames{i.stack.depth()}, values{i.values.size()} {}
+        ~Unwind() { 
+            frames_only();
+            if (interp.values.size() > values) interp.values.erase(interp.values.begin() + values, interp.values.end());
+        }
+        void frames_only() { interp.stack.unwind(frames); }
+        size_t depth() const { return frames; }
+    private:
+        Interpreter& interp;
+        size_t frames, values;
+    };
+
+    Cell eval(Interpreter& interp, Span expr, Env* env);
+    void evlist(Interpreter& interp, Span expr, Env* env);     // pushes the values onto interp.values
+    void arguments(Interpreter& interp, const Cell* p, const Cell* last, Env* env);    // of the proc name at p, likewise
+    Cell call(Interpreter& interp, const Cell& proc, size_t args);     // args are interp.values from index args on
+    Env* enter(Interpreter& interp, const Cell& proc, size_t args);
+    bool captures(Span body);   // makes closures or defines, so frames it runs in may escape
+    bool defines(Span body);
+    Proc* closure(Interpreter& interp, const List& params, const List& body, Env* env);
+    Cell apply_prim(const Cell& prim, Values args);    // moves out of args
+    bool accessor(const Cell& prim);    // car, cdr or empty?, which can read a variable in place
+    Cell access(const Cell& prim, const Cell& arg);
+    void collapse(List& values, size_t base);   // the values pushed from base on as one cell
 }
 #endif
@@ -0,0 +1,417 @@
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include "server.h"
+#include "parser.h"
+#include "error.h"
+
+using namespace Lexer;
+using namespace Parser;
+using namespace Environment;
+using Clock = std::chrono::steady_clock;
+
+void Server::run(Interpreter& interp, istream& in, bool print_res, const function<void()>& done) {
+    Cell_stream& cs = interp.cs;
+    ostream& out = *interp.outstream;
+    auto depth = cs.depth();
+    cs.set_input(in);
+    while (true) {
+        try {
+            auto res = eval(interp, read(interp), &interp.e0);
+            if (print_res && res.kind != Kind::End && res.kind != Kind::Include) {
+                out << res << '\n';
+                if (done) done();
+            }
+            interp.heap.end_region(res);
+            if (res.kind == Kind::End || cs.eof()) { cs.reset(); if (cs.depth() == depth) return; }
+        }
+        catch (exception& e) {
+            out << e.what() << endl;    // continue with the next expression
+            if (done) done();
+        }
+    }
+}
+
+namespace {
+    struct Report {     // sent to the parent after every job, small enough for an atomic pipe write
+        pid_t pid;
+        long jobs;
+        double busy;    // seconds spent serving jobs
+    };
+
+    volatile sig_atomic_t stop {0};
+    volatile sig_atomic_t show {0};
+    volatile sig_atomic_t reap {0};
+
+    void on_signal(int sig) {
+        if (sig == SIGUSR1) show = 1;
+        else if (sig == SIGCHLD) reap = 1;
+        else stop = 1;
+    }
+
+    void handle(int sig, void (*handler)(int)) {
+        struct sigaction sa {};
+        sa.sa_handler = handler;
+        sigemptyset(&sa.sa_mask);
+        sigaction(sig, &sa, nullptr);
+    }
+
+    string read_all(int fd) {   // a request ends when the client shuts down its write side
+        string res;
+        char buf[4096];
+        ssize_t got;
+        while ((got = read(fd, buf, sizeof buf)) != 0) {
+            if (got < 0) { if (errno == EINTR) continue; break; }
+            res.append(buf, got);
+        }
+        return res;
+    }
+
+    bool write_all(int fd, const char* p, size_t n) {   // false once the other end is gone (EPIPE) or failing
+        for (size_t done = 0; done < n; ) {
+            ssize_t put = write(fd, p + done, n - done);
+            if (put < 0) { if (errno == EINTR) continue; return false; }
+            done += put;
+        }
+        return true;
+    }
+
+    [[noreturn]] void worker(int listener, int stats, shared_ptr<Interpreter> base) {
+        Report r {getpid(), 0, 0};
+        while (true) {
+            int conn = accept(listener, nullptr, nullptr);
+            if (conn < 0) { if (errno == EINTR) continue; _exit(1); }
+            auto begin = Clock::now();
+            string job = read_all(conn);
+            string path = job.substr(0, job.find_last_not_of(" \t\r\n") + 1);
+            ostringstream out;
+            {   // fresh fork of the prelude per job so defines never leak between jobs
+                Interpreter interp {base, cin, out};
+                ifstream file {path};
+                if (!path.empty() && file) Server::run(interp, file, true);   // script path
+                else { istringstream in {job}; Server::run(interp, in, true); }   // inline expressions
+            }
+            string results = out.str();
+            write_all(conn, results.data(), results.size());    // a client that left misses them
+            close(conn);
+            ++r.jobs;
+            r.busy += chrono::duration<double>(Clock::now() - begin).count();
+            // whole, as the parent reads whole reports; one is under PIPE_BUF, so workers never interleave
+            if (!write_all(stats, reinterpret_cast<const char*>(&r), sizeof r)) _exit(0);  // the parent is gone
+        }
+    }
+
+    shared_ptr<Interpreter> load(const vector<string>& preludes) {
+        auto base = make_shared<Interpreter>();
+        for (auto& name : preludes) {
+            ifstream file {name};
+            if (!file) throw runtime_error("Cannot open prelude " + name);
+            Server::run(*base, file, false);
+        }
+        base->freeze();     // only ever forked from after this
+        return base;
+    }
+
+    int listen_on(const string& socket_path) {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof addr.sun_path) throw runtime_error("Socket path too long");
+        strcpy(addr.sun_path, socket_path.c_str());
+        unlink(socket_path.c_str());
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0 || listen(listener, 128) < 0)
+            throw runtime_error("Cannot listen on " + socket_path + ": " + strerror(errno));
+        return listener;
+    }
+
+    struct Worker {
+        Clock::time_point start;
+        Report last;
+        bool alive;
+    };
+
+    void print_report(ostream& os, const map<pid_t, Worker>& workers) {
+        long jobs {0};
+        double rate {0};
+        for (auto& w : workers) {
+            double up = chrono::duration<double>(Clock::now() - w.second.start).count();
+            double r = w.second.last.jobs / up;
+            os << "worker " << w.first << (w.second.alive? "" : " (exited)") << ": " << w.second.last.jobs << " jobs in "
+               << up << "s, " << r << " jobs/s, " << 100 * w.second.last.busy / up << "% busy\n";
+            jobs += w.second.last.jobs;
+            if (w.second.alive) rate += r;
+        }
+        os << "total: " << jobs << " jobs, " << rate << " jobs/s" << endl;
+    }
+}
+
+int Server::prefork(int n, const string& socket_path, const vector<string>& preludes) {
+    auto base = load(preludes);     // workers share these pages copy on write
+    int listener = listen_on(socket_path);
+    int stats[2];
+    if (pipe(stats) < 0) throw runtime_error("Cannot create stats pipe");
+
+    handle(SIGINT, on_signal);
+    handle(SIGTERM, on_signal);
+    handle(SIGUSR1, on_signal);
+    handle(SIGCHLD, on_signal);
+
+    map<pid_t, Worker> workers;
+    auto spawn = [&]() {
+        pid_t pid = fork();
+        if (pid < 0) throw runtime_error("Cannot fork worker");
+        if (pid == 0) {
+            close(stats[0]);
+            signal(SIGINT, SIG_IGN);    // parent decides when workers stop
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGUSR1, SIG_IGN);
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGPIPE, SIG_IGN);   // a client or the parent gone is EPIPE from write, not the end of the worker
+            worker(listener, stats[1], base);
+        }
+        workers[pid] = {Clock::now(), {pid, 0, 0}, true};
+    };
+    for (int i = 0; i < n; ++i) spawn();
+    cerr << "serving " << socket_path << " with " << n << " workers, SIGUSR1 prints throughput\n";
+
+    pollfd pfd {stats[0], POLLIN, 0};
+    while (!stop) {
+        if (poll(&pfd, 1, 1000) > 0) {
+            Report r;
+            if (read(stats[0], &r, sizeof r) == sizeof r && workers.count(r.pid)) workers[r.pid].last = r;
+        }
+        if (reap) {     // replace workers that died, e.g. from a script overflowing the stack
+            reap = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0)
+                if (workers.count(pid) && workers[pid].alive) { workers[pid].alive = false; if (!stop) spawn(); }
+        }
+        if (show) { show = 0; print_report(cerr, workers); }
+    }
+
+    for (auto& w : workers) if (w.second.alive) kill(w.first, SIGTERM);
+    while (wait(nullptr) > 0 || errno == EINTR) ;
+    Report r;
+    while (poll(&pfd, 1, 0) > 0 && read(stats[0], &r, sizeof r) == sizeof r)   // reports written before exiting
+        if (workers.count(r.pid)) workers[r.pid].last = r;
+    print_report(cout, workers);
+    unlink(socket_path.c_str());
+    return 0;
+}
+
+namespace {
+    // 4 byte big endian length then the payload, an empty frame ends the results of a request
+    constexpr size_t max_request = 1 << 20;     // payload bytes, a longer request closes the session
+
+    string frame(const string& payload) {
+        uint32_t n = payload.size();
+        return string{char(n >> 24), char(n >> 16), char(n >> 8), char(n)} + payload;
+    }
+
+    struct Session {
+        Session(shared_ptr<Interpreter> base, int f) : fd{f}, interp{base, cin, results} {}
+        int fd;
+        ostringstream results;      // printed by interp, sent as a frame after each expression
+        Interpreter interp;         // overlay on the prelude for the whole connection
+        string in;                  // bytes read but not yet a whole frame
+        deque<string> requests;     // whole frames waiting to be evaluated in order
+        string out;                 // frames waiting to be written
+        bool busy {false};          // a worker is evaluating its requests
+        bool hungup {false};        // peer will send no more requests
+        bool dead {false};          // peer went away, drop any further output
+    };
+
+    struct Pool {   // everything shared between the event loop and the workers, guarded by m
+        mutex m;
+        condition_variable cv;
+        deque<shared_ptr<Session>> ready;   // sessions with requests and no worker
+        vector<shared_ptr<Session>> dirty;  // sessions the event loop has to look at
+        bool stopping {false};
+        int wake;                           // eventfd the event loop sleeps on
+        long requests {0};
+        long results {0};
+
+        void notify(const shared_ptr<Session>& s) {
+            dirty.push_back(s);
+            uint64_t one {1};
+            write(wake, &one, sizeof one);
+        }
+    };
+
+    void evaluate(Pool& pool, const shared_ptr<Session>& s) {
+        unique_lock<mutex> lock {pool.m};
+        while (!s->requests.empty() && !s->dead && !pool.stopping) {
+            string request = move(s->requests.front());
+            s->requests.pop_front();
+            lock.unlock();
+            istringstream in {request};
+            Server::run(s->interp, in, true, [&]() {   // stream each result back as soon as it is printed
+                string text = s->results.str();
+                s->results.str("");
+                lock_guard<mutex> guard {pool.m};
+                s->out += frame(text);
+                ++pool.results;
+                pool.notify(s);
+            });
+            lock.lock();
+            s->out += frame("");
+            ++pool.requests;
+            pool.notify(s);
+        }
+        s->busy = false;
+        pool.notify(s);     // the event loop closes it if the peer hung up
+    }
+
+    void work(Pool& pool) {
+        unique_lock<mutex> lock {pool.m};
+        while (true) {
+            pool.cv.wait(lock, [&]() { return pool.stopping || !pool.ready.empty(); });
+            if (pool.stopping) return;
+            auto s = pool.ready.front();
+            pool.ready.pop_front();
+            lock.unlock();
+            evaluate(pool, s);
+            lock.lock();
+        }
+    }
+}
+
+int Server::serve(int n, const string& socket_path, const vector<string>& preludes) {
+    auto base = load(preludes);
+    int listener = listen_on(socket_path);
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    Pool pool;
+    pool.wake = eventfd(0, EFD_NONBLOCK);
+    int ep = epoll_create1(0);
+    auto watch = [&](int fd, uint32_t events, int op) {
+        epoll_event ev {};
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(ep, op, fd, &ev);
+    };
+    watch(listener, EPOLLIN, EPOLL_CTL_ADD);
+    watch(pool.wake, EPOLLIN, EPOLL_CTL_ADD);
+    handle(SIGINT, on_signal);
+    handle(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    sigset_t stops, old;    // workers block the stop signals so they always wake the event loop
+    sigemptyset(&stops);
+    sigaddset(&stops, SIGINT);
+    sigaddset(&stops, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stops, &old);
+    vector<thread> workers;
+    for (int i = 0; i < n; ++i) workers.emplace_back(work, ref(pool));
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    map<int, shared_ptr<Session>> sessions;     // only touched by the event loop
+    long served {0};
+
+    auto flush = [&](shared_ptr<Session> s) {  // with pool.m held
+        while (!s->dead && !s->out.empty()) {
+            ssize_t put = send(s->fd, s->out.data(), s->out.size(), MSG_NOSIGNAL);
+            if (put < 0) { if (errno == EINTR) continue; if (errno != EAGAIN) s->dead = true; break; }
+            s->out.erase(0, put);
+        }
+        if (s->dead) s->out.clear();
+        if (!s->busy && s->out.empty() && (s->dead || (s->hungup && s->requests.empty()))) {
+            epoll_ctl(ep, EPOLL_CTL_DEL, s->fd, nullptr);
+            close(s->fd);
+            sessions.erase(s->fd);
+        }
+        else if (s->dead) epoll_ctl(ep, EPOLL_CTL_DEL, s->fd, nullptr);    // wait for its worker
+        else watch(s->fd, (s->hungup? 0 : EPOLLIN) | (s->out.empty()? 0 : EPOLLOUT), EPOLL_CTL_MOD);
+    };
+
+    auto receive = [&](shared_ptr<Session> s, uint32_t events) {
+        string got;
+        char buf[4096];
+        bool hungup {false}, dead {(events & (EPOLLHUP | EPOLLERR)) != 0};
+        while (!dead) {
+            ssize_t r = read(s->fd, buf, sizeof buf);
+            if (r > 0) got.append(buf, r);
+            else if (r == 0) { hungup = true; break; }
+            else if (errno != EINTR) { dead = errno != EAGAIN; break; }
+        }
+        lock_guard<mutex> lock {pool.m};
+        s->in += got;
+        s->hungup = s->hungup || hungup;
+        s->dead = s->dead || dead;
+        while (s->in.size() >= 4) {
+            auto b = reinterpret_cast<const unsigned char*>(s->in.data());
+            size_t len = uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | b[3];
+            if (len > max_request) {    // rather than buffering up to 4GB of it
+                s->dead = true;
+                s->in.clear();
+                break;
+            }
+            if (s->in.size() < 4 + len) break;
+            s->requests.push_back(s->in.substr(4, len));
+            s->in.erase(0, 4 + len);
+        }
+        if (!s->busy && !s->dead && !s->requests.empty()) {
+            s->busy = true;
+            pool.ready.push_back(s);
+            pool.cv.notify_one();
+        }
+        flush(s);
+    };
+
+    cerr << "serving " << socket_path << " with " << n << " threads\n";
+    epoll_event events[64];
+    while (!stop) {
+        int count = epoll_wait(ep, events, 64, -1);
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+                int c;
+                while ((c = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+                    sessions[c] = make_shared<Session>(base, c);    // O(1) fork of the prelude
+                    watch(c, EPOLLIN, EPOLL_CTL_ADD);
+                    ++served;
+                }
+            }
+            else if (fd == pool.wake) {
+                uint64_t wakes;
+                read(pool.wake, &wakes, sizeof wakes);
+                lock_guard<mutex> lock {pool.m};
+                auto dirty = move(pool.dirty);
+                pool.dirty.clear();
+                for (auto& s : dirty) {
+                    auto p = sessions.find(s->fd);
+                    if (p != sessions.end() && p->second == s) flush(s);
+                }
+            }
+            else if (sessions.count(fd)) {
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive(sessions[fd], events[i].events);
+                else { lock_guard<mutex> lock {pool.m}; flush(sessions[fd]); }
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> lock {pool.m};
+        pool.stopping = true;
+    }
+    pool.cv.notify_all();
+    for (auto& t : workers) t.join();   // each finishes the expression it is evaluating
+    for (auto& s : sessions) close(s.first);
+    cout << "served " << served << " sessions, " << pool.requests << " requests, " << pool.results << " results" << endl;
+    unlink(socket_path.c_str());
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef clispp_server
+#define clispp_server
+#include <string>
+#include <vector>
+#include <functional>
+#include "interpreter.h"
+
+namespace Server {
+    using namespace std;
+    using Environment::Interpreter;
+
+    // evaluates every expression of in, following includes, printing results to interp's outstream
+    // and calling done after each expression
+    void run(Interpreter& interp, istream& in, bool print_res, const function<void()>& done = nullptr);
+
+    // load preludes once, then n forked workers serve script paths or inline expressions sent to socket_path
+    int prefork(int n, const string& socket_path, const vector<string>& preludes);
+
+    // load preludes once, then serve length prefixed requests from many clients on socket_path,
+    // evaluated by n threads with one environment overlay per connection
+    int serve(int n, const string& socket_path, const vector<string>& preludes);
+}
+#endif
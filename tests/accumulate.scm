@@ -0,0 +1,23 @@
+; run: --accumulate
+; run: --closures --accumulate
+; procs recursing through + * or cons on the way back run as loops, with cons results in the same order
+(begin (include tests/stat.scm) 0)
+(begin (include funcs.scm) 0)
+(define (upto n acc) (cond ((= n 0) acc) (else (upto (- n 1) (cons n acc)))))
+(define (range a b) (cond ((> a b) ()) (else (cons a (range (+ a 1) b)))))
+(define (copy seq) (cond ((empty? seq) ()) (else (cons (car seq) (copy (cdr seq))))))
+(define (total seq) (cond ((empty? seq) 0) (else (+ (car seq) (total (cdr seq))))))
+(range 1 10)
+(map square (1 2 3 4 5))
+(copy (list 'a 'b 'c))
+(map inc ())
+(expt 2 10)
+(factorial 10)
+(total (1 2 3 4))
+(begin (define big (range 1 6000)) 0)
+(car big)
+(car (cdr big))
+(total big)
+(car (cdr (map inc big)))
+(car (copy big))
+(> (stat 'accumulated) 0)
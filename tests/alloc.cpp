@@ -0,0 +1,58 @@
+// a tail recursive loop allocates nothing per iteration, whether it runs natively or not: prints how
+// many more operator news a million iterations take than ten, under the walker and --closures
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include "parser.h"
+
+using namespace std;
+using namespace Environment;
+
+namespace {
+    atomic<size_t> allocations {0};
+}
+
+// counted here rather than in the library, which leaves operator new alone
+void* operator new(size_t n) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n? n : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+    void load(Interpreter& interp, const string& source) {
+        istringstream in {source};
+        interp.cs.set_input(in);
+        while (!interp.cs.eof()) interp.heap.end_region(Parser::eval(interp, Parser::read(interp), &interp.e0));
+        interp.cs.reset();
+    }
+
+    size_t cost(Interpreter& interp, const string& form) {
+        istringstream in {form};
+        interp.cs.set_input(in);
+        List expr = Parser::read(interp);
+        interp.cs.reset();
+        size_t before = allocations.load(memory_order_relaxed);
+        interp.heap.end_region(Parser::eval(interp, expr, &interp.e0));
+        return allocations.load(memory_order_relaxed) - before;
+    }
+}
+
+int main() {
+    for (bool closures : {false, true}) {
+        Interpreter interp;
+        if (closures) interp.mode = Interpreter::Mode::Closures;
+        load(interp, "(define (loop n acc) (cond ((= n 0) acc) (else (loop (- n 1) (+ acc 1)))))\n"
+                     "(define (walk n acc) (cond ((= n 0) 'done) (else (let ((m (- n 1))) (begin acc (walk m (+ acc 1)))))))\n"
+                     "(loop 1000 0)\n(walk 1000 0)\n");
+        for (string f : {"loop", "walk"}) {
+            cost(interp, "(" + f + " 10 0)");   // whatever the first calls set up
+            long extra = long(cost(interp, "(" + f + " 1000000 0)")) - long(cost(interp, "(" + f + " 10 0)"));
+            cout << (closures? "--closures " : "walker ") << f << ' ' << extra << '\n';
+        }
+    }
+}
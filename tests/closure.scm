@@ -0,0 +1,33 @@
+; flat closures copy what they capture from frames that can no longer change, and still see
+; later changes to globals and to frames that define
+(begin (include funcs.scm) 0)
+(define base 10)
+(define (adder n) (lambda (x) (+ x (+ n base))))
+(define add1 (adder 1))
+(add1 0)
+(define base 100)
+(add1 0)
+(define (outer a) (let ((b (* a 2))) (lambda (c) (+ a (+ b c)))))
+(define f (outer 2))
+(f 3)
+(define (nested a) (lambda (b) (lambda (c) (+ a (+ b c)))))
+(define g1 (nested 1))
+(define g (g1 20))
+(g 300)
+(define (counter-with-local start) (begin (define step 5) (lambda (x) (+ x (+ start step)))))
+(define h (counter-with-local 1))
+(h 0)
+(define (shadow x) (let ((x (* x 10))) (lambda (y) (+ x y))))
+(define s (shadow 2))
+(s 1)
+(define (later) (lambda (x) (defined-later x)))
+(define call-later (later))
+(define (defined-later x) (* x 7))
+(call-later 6)
+(define (fact n) (cond ((= n 0) 1) (else (* n (fact (- n 1))))))
+(define (fact-of n) (lambda (unused) (fact n)))
+(define fact5 (fact-of 5))
+(fact5 0)
+(define (compose2 f g) (lambda (x) (f (g x))))
+(define sq-inc (compose2 square inc))
+(sq-inc 4)
@@ -0,0 +1,37 @@
+; run:
+; run: --closures
+; the closure compiler gives the tree walker's results, errors included
+(begin (include funcs.scm) 0)
+(square 5)
+(cube 3)
+(define square-cube (compose square cube))
+(square-cube 2)
+(linear-sum 1 100)
+(gcd 84 36)
+(fib 30)
+(map square (1 2 3 4))
+(filter even? (1 2 3 4 5 6))
+(reduce add 0 (1 2 3 4))
+(add4 3)
+(define (counter start) (lambda (n) (+ start n)))
+(define from10 (counter 10))
+(from10 5)
+(define (shadow x) (let ((x (* x 2))) (let ((y (+ x 1))) (list x y))))
+(shadow 4)
+(define (late) (+ defined-later 1))
+(define defined-later 41)
+(late)
+(define (local-define n) (begin (define k (* n 3)) (+ k 1)))
+(local-define 2)
+(let ((f (lambda (a b) (- a b)))) (f 10 4))
+(cat 'foo 'bar)
+(car (list 1 2 3))
+(cdr (list 1 2 3))
+(cons 1 (2 3))
+(empty? ())
+(and (< 1 2) (> 3 2))
+(or (< 2 1) (= 1 1))
+'quoted
+(undefined-name 1)
+(car)
+(cond ((= 1 2) 1) (else 2))
@@ -0,0 +1,29 @@
+# clisp --compile: the program prints what clisp -p prints for the same script, running numeric procs
+# as C++ and everything else, included files too, on the interpreter; it needs none of the files
+clisp=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+dir=$(mktemp -d)
+cat >"$dir/helper.scm" <<'END'
+(define (pair a b) (cons a (cons b ())))
+(define (twice f) (lambda (x) (f (f x))))
+END
+cat >"$dir/prog.scm" <<'END'
+(begin (include helper.scm) 0)
+(define (fib n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2))))))
+(define (sum-to n acc) (cond ((= n 0) acc) (else (sum-to (- n 1) (+ acc n)))))
+(define (inc x) (+ x 1))
+(fib 20)
+(sum-to 1000 0)
+(pair (fib 10) 'x)
+(define add2 (twice inc))
+(add2 (sum-to 10 0))
+(fib 'x)
+END
+(cd "$dir" && $clisp --compile prog.scm -o prog 2>&1)
+mkdir "$dir/elsewhere"
+mv "$dir/prog" "$dir/elsewhere"
+(cd "$dir/elsewhere" && ./prog -p </dev/null)
+echo "-- a path the shell would have to quote"
+(cd "$dir" && $clisp --compile prog.scm -o "it's here" 2>/dev/null && ./"it's here" -p </dev/null | head -1)
+echo "-- clisp -p"
+(cd "$dir" && $clisp prog.scm -p </dev/null | sed -n 's/^> //p' | grep -v '^\. $')
+rm -rf "$dir"
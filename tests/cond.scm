@@ -0,0 +1,14 @@
+; run:
+; run: --closures
+; a cond with no clause that matches raises, whether eval runs it, evlist runs it as an argument or
+; it is enclosed in parentheses
+(define two 2)
+(cond ((= 1 two) 5))
+((cond ((= 1 two) 5)))
+(+ 1 (cond ((= 1 two) 5)))
+(list 1 (cond ((= 1 two) 5) ((= 2 two) 6)))
+(define (side x) (cond ((< x 0) 10) ((> x 0) 20)))
+(side 3)
+(side 0)
+(+ (side 0) 1)
+(+ (side (- 0 3)) 1)
@@ -0,0 +1,19 @@
+; values move through eval and the primitives: reading a bound list copies nothing, and consing
+; onto a global list copies it once
+(begin (include tests/stat.scm) 0)
+(define lst '(1 2 3 4 5 6 7 8))
+(define (peek n acc) (cond ((= n 0) acc) (else (peek (- n 1) (+ acc (car lst))))))
+(define (grow n acc) (cond ((= n 0) acc) (else (grow (- n 1) (+ acc (car (cons 0 lst)))))))
+(define (copies f n) (let ((before (stat 'list-copies))) (begin (f n 0) (- (stat 'list-copies) before))))
+(begin (copies peek 10) (copies grow 10) 0)
+(- (copies peek 1010) (copies peek 10))
+(- (copies grow 1010) (copies grow 10))
+(define (take-car l) (car l))
+(take-car lst)
+(cons 0 lst)
+(cdr lst)
+lst
+(define (rest-of l) (cdr (cdr l)))
+(rest-of lst)
+lst
+(empty? lst)
@@ -0,0 +1,36 @@
+; primitives of literals fold, cond clauses that can never run are pruned and identity operands are
+; dropped as each form is read, while names, redefinitions and evlist's cond keep their meaning
+(begin (include tests/stat.scm) 0)
+(define (counts) (cons (stat 'folds) (cons (stat 'cond-pruned) (cons (stat 'identities) ()))))
+(counts)
+(* 60 60 24)
+(define (f x) (+ x (* 60 60 24)))
+(f 1)
+(counts)
+(define (g x) (cond ((< 2 1) 'no) ((= 1 1) (+ x 1)) (else x)))
+(g 5)
+(define (q) (cond (else (+ 1 1))))
+(q)
+(counts)
+(define (h x) (+ (* x 2) 0))
+(h 4)
+(define (k x) (* 1 x 1))
+(k 7)
+(- 5 0 0)
+(counts)
+(define (sq x) (* x x))
+(define (m x) (+ sq 3 0))
+(m 2)
+(define (s x) (cond ((< 1 2) x (+ 1 1)) (else 0)))
+(s 9)
+(define (r x) (let ((y (+ 1 2))) (cond ((> 1 2) y) (else (+ x y)))))
+(r 1)
+(counts)
+(define (sq x) (+ x x))
+(m 2)
+(define (late x) (+ x (offset 1) 0))
+(define (offset y) (* y 10))
+(late 1)
+(define (offset y) (* y 20))
+(late 1)
+(counts)
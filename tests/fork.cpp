@@ -0,0 +1,64 @@
+// interpreters forked from a frozen base share its definitions, and each keeps its own on top
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "parser.h"
+
+using namespace std;
+using namespace Parser;
+
+namespace {
+    void run(Interpreter& interp) {     // each form of its input, printed as clisp -p does
+        ostream& out = *interp.outstream;
+        while (true) {
+            try {
+                Cell res = eval(interp, expr(interp, true), &interp.e0);
+                if (res.kind == Kind::End) break;
+                out << res << '\n';
+            }
+            catch (exception& e) {
+                out << e.what() << '\n';
+            }
+        }
+    }
+}
+
+int main() {
+    istringstream prelude {
+        "(define limit 10)\n"
+        "(define (adder n) (lambda (x) (+ x n)))\n"
+        "(define add5 (adder 5))\n"
+        "(define (capped x) (cond ((< x limit) x) (else limit)))\n"};
+    ostringstream ignored;
+    auto base = make_shared<Interpreter>(prelude, ignored);
+    run(*base);
+    try { Interpreter early {base}; }
+    catch (exception& e) { cout << e.what() << '\n'; }
+    base->freeze();
+
+    string script {
+        "(add5 1)\n"
+        "(define limit 3)\n"
+        "(capped 7)\n"
+        "limit\n"
+        "(define add5 (adder 50))\n"
+        "(add5 1)\n"};
+    istringstream first_in {script + "(define mine 'first)\nmine\n"}, second_in {script + "mine\n"};
+    ostringstream first_out, second_out;
+    Interpreter first {base, first_in, first_out}, second {base, second_in, second_out};
+    thread a {run, ref(first)}, b {run, ref(second)};
+    a.join();
+    b.join();
+    cout << "first\n" << first_out.str() << "second\n" << second_out.str();
+
+    istringstream after {"(add5 1)\nlimit\n(define limit 0)\n"};
+    ostringstream base_out;
+    base->cs.set_input(after);
+    base->outstream = &base_out;
+    run(*base);
+    cout << "base\n" << base_out.str();
+
+    for (int i = 0; i < 100000; ++i) Interpreter fork {base};   // nothing is copied
+    cout << "forked\n";
+}
@@ -0,0 +1,24 @@
+; frames of procs and lets that make no closures are reused, and those that do outlive their call
+(begin (include funcs.scm) 0)
+(define (loop n) (cond ((= n 0) 'done) (else (loop (- n 1)))))
+(define (churn n) (cond ((= n 0) 'done) (else (begin (loop 1000) (churn (- n 1))))))
+(define (sum3 a b c) (+ a (+ b c)))
+(sum3 1 (sum3 2 3 4) (sum3 5 6 7))
+(define (depth n) (cond ((= n 0) 0) (else (+ 1 (depth (- n 1))))))
+(depth 500)
+(define from-let (let ((x 5) (y 6)) (lambda (z) (+ x (+ y z)))))
+(let ((a 1)) (let ((b 2)) (+ a b)))
+(churn 50)
+(from-let 1)
+(define (make-pair a b) (lambda (pick) (cond (pick a) (else b))))
+(define p (make-pair (sum3 1 1 1) (let ((q 4)) (* q q))))
+(churn 50)
+(p (= 1 1))
+(p (= 1 2))
+(define (scaled k) (let ((twice-k (* 2 k))) (lambda (x) (* x twice-k))))
+(define by6 (scaled 3))
+(sum3 (by6 1) (by6 2) (depth 10))
+(define (local-helper n) (begin (define (helper m) (* m n)) (helper 4)))
+(local-helper 5)
+(churn 50)
+(by6 10)
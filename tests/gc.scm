@@ -0,0 +1,20 @@
+; frames and procs stay alive across minor and major collections while they are reachable
+(begin (include funcs.scm) 0)
+(define (loop n) (cond ((= n 0) 'done) (else (loop (- n 1)))))
+(define (churn n) (cond ((= n 0) 'done) (else (begin (loop 1000) (churn (- n 1))))))
+(define (make-counter start) (lambda (step) (+ start step)))
+(define (twice g) (lambda (x) (g (g x))))
+(define old (make-counter 100))
+(churn 200)
+(old 1)
+(define (keep n) (cond ((= n 0) (make-counter 7)) (else (keep (- n 1)))))
+(define young (keep 1000))
+(churn 200)
+(young 1)
+(define add4 (twice (twice inc)))
+(define add16 (twice (twice add4)))
+(churn 200)
+(add4 0)
+(add16 0)
+(linear-sum 1 (young (old 0)))
+(reduce add 0 (map (make-counter 10) (list 1 2 3 4 5)))
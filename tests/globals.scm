@@ -0,0 +1,26 @@
+; run:
+; run: --closures
+; a site naming a top-level variable finds it again after every define at the top level, and a
+; loop reading one looks it up a fixed number of times however long it runs
+(begin (include tests/stat.scm) 0)
+(define k 10)
+(define (f x) (+ x k))
+(f 1)
+(define k 20)
+(f 1)
+(define (h x) (+ (u x) 1))
+(h 3)
+(define (u x) (* x 2))
+(h 3)
+(define (u x) (* x 3))
+(h 3)
+(define (step x) (+ x k))
+(define (loop n acc) (cond ((= n 0) acc) (else (loop (- n 1) (step acc)))))
+(define (local n) (begin (define k 1) (step n)))
+(local 5)
+(loop 5 0)
+(define k 2)
+(loop 5 0)
+(define (misses n) (let ((before (stat 'global-misses))) (begin (loop n 0) (- (stat 'global-misses) before))))
+(begin (misses 10) 0)
+(= (misses 10) (misses 100000))
@@ -0,0 +1,28 @@
+; run:
+; run: --pause-us 50
+; a major collection runs in steps between allocations, and every pause lands in the histogram
+(begin (include tests/stat.scm) 0)
+(define (make-counter start) (lambda (step) (+ start step)))
+(define (hold n k) (cond ((= n 0) 0) (else (+ 1 (hold (- n 1) (make-counter n))))))
+(define (churn n) (cond ((= n 0) 'done) (else (begin (hold 2000 0) (churn (- n 1))))))
+(define (twice g) (lambda (x) (g (g x))))
+(define old (make-counter 100))
+(define add4 (twice (twice (make-counter 1))))
+(churn 100)
+(old 1)
+(add4 0)
+(define (histogram pairs) (cond ((= (car (car pairs)) 'pauses<4us) pairs) (else (histogram (cdr pairs)))))
+(define (bucket pairs) (car (cdr (car pairs))))
+; the values of the n histogram pairs; cdr of a two element list is its last element
+(define (total n pairs) (cond ((= n 1) (car (cdr pairs))) (else (+ (bucket pairs) (total (- n 1) (cdr pairs))))))
+(begin (define now (stats)) 0)
+(begin (define pauses (total 8 (histogram now))) 0)
+(begin (define counted (+ (lookup 'minor now) (lookup 'steps now))) 0)
+(define failed 'failed)
+(define (check ok) (cond (ok 'ok) (else failed)))
+(check (> (stat 'major) 0))
+(check (> (stat 'steps) 0))
+(check (< (stat 'pause-max-us) (stat 'pause-total-us)))
+(check (> pauses (- counted 1)))
+; each major collection also pauses to begin, and allocation can outrun its steps once
+(check (< pauses (+ counted (* 2 (lookup 'major now)) 3)))
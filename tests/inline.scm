@@ -0,0 +1,22 @@
+; run: --closures
+; calls to small top-level procs are compiled into the caller, and go back to calling the proc once
+; its name is defined again
+(begin (include tests/stat.scm) 0)
+(begin (define inlined (stat 'inlined)) (define deopts (stat 'deopts)) 0)
+(define (inc x) (+ x 1))
+(define (add x y) (+ x y))
+(define (sum a b) (cond ((> a b) 0) (else (add a (sum (inc a) b)))))
+(define (loop i acc) (cond ((= i 0) acc) (else (loop (- i 1) (add acc i)))))
+(sum 1 100)
+(loop 100000 0)
+(> (stat 'inlined) inlined)
+(- (stat 'deopts) deopts)
+(define (inc x) (* x 2))
+(define (add x y) (- x y))
+(sum 1 5)
+(loop 10 0)
+(loop 10 0)
+(- (stat 'deopts) deopts)
+(define (add x y) (list x y))
+(loop 2 0)
+(- (stat 'deopts) deopts)
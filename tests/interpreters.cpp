@@ -0,0 +1,49 @@
+// two interpreters in one process, each on its own thread with its own input, output and globals
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include "parser.h"
+
+using namespace std;
+using namespace Parser;
+
+namespace {
+    const string forms {
+        "(define x 1)\n"
+        "(define (count n) (cond ((= n 0) x) (else (count (- n 1)))))\n"
+        "(count 500)\n"
+        "(define (twice f) (lambda (y) (f (f y))))\n"
+        "(define scale (twice (lambda (y) (* y x))))\n"
+        "(scale 3)\n"
+        "(define x 2)\n"
+        "(count 3)\n"
+        "(other 1)\n"};
+    
+    // evaluates each form of the interpreter's input, printing the first shown results as clisp -p
+    // does; the rest repeat them, so the two threads overlap
+    void run(Interpreter* interp, int shown) {
+        ostream& out = *interp->outstream;
+        for (int n = 0; ; ++n) {
+            try {
+                Cell res = eval(*interp, expr(*interp, true), &interp->e0);
+                if (res.kind == Kind::End) break;
+                if (n < shown) out << res << '\n';
+            }
+            catch (exception& e) {
+                if (n < shown) out << e.what() << '\n';
+            }
+        }
+    }
+}
+
+int main() {
+    string rounds;
+    for (int i = 0; i < 200; ++i) rounds += forms;
+    istringstream first_in {rounds}, second_in {"(define (other n) (+ n 100))\n" + rounds};
+    ostringstream first_out, second_out;
+    Interpreter first {first_in, first_out}, second {second_in, second_out};
+    thread a {run, &first, 9}, b {run, &second, 10};
+    a.join();
+    b.join();
+    cout << "first\n" << first_out.str() << "second\n" << second_out.str();
+}
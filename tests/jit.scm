@@ -0,0 +1,24 @@
+; run:
+; run: --closures
+; a numeric proc is translated to machine code after 100 calls and gives the same results, and falls
+; back to the interpreter while its arguments or free variables are not numbers
+(begin (include tests/stat.scm) 0)
+(define (fact n) (cond ((< n 2) 1) (else (* n (fact (- n 1))))))
+(define (gcd a b) (cond ((< a b) (gcd a (- b a))) ((< b a) (gcd (- a b) b)) (else a)))
+(define limit 3)
+(define (above x) (cond ((< x limit) 0) (else 1)))
+(define (warm n) (cond ((= n 0) 0) (else (begin (fact (+ n 1)) (gcd (+ n 12) 18) (above (- n 1)) (warm (- n 1))))))
+(define before (stat 'jit-procs))
+(warm 150)
+(- (stat 'jit-procs) before)
+(fact 10)
+(fact 170)
+(gcd 1071 462)
+(above 2)
+(above 14)
+(define limit 'a)
+(above 14)
+(define limit 20)
+(above 14)
+(fact 'x)
+(fact 3)
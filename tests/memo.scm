@@ -0,0 +1,35 @@
+; run:
+; run: --closures
+; memoized procs answer repeated arguments from a cache holding the capacity most recently used
+; results; (since) gives the memo-hits, memo-misses and memo-evictions since marked was defined
+(begin (include tests/stat.scm) 0)
+(define (counts) (list (stat 'memo-hits) (stat 'memo-misses) (stat 'memo-evictions)))
+(define (delta now then) (cond ((empty? now) ()) (else (cons (- (car now) (car then)) (delta (cdr now) (cdr then))))))
+(define (since) (delta (counts) marked))
+(define-memo (fib n) (cond ((< n 2) n) (else (+ (fib (- n 1)) (fib (- n 2))))))
+(fib 80)
+(define-memo (sq x) (* x x) 2)
+(begin (define marked (counts)) 0)
+(sq 2)
+(sq 3)
+(sq 2)
+(since)
+(sq 4)
+(since)
+(begin (define marked (counts)) 0)
+(sq 2)
+(sq 3)
+(since)
+(define (slow n) (cond ((< n 2) n) (else (+ (slow (- n 1)) (slow (- n 2))))))
+(define fast (memoize slow 1))
+(begin (define marked (counts)) 0)
+(fast 15)
+(fast 15)
+(fast 16)
+(fast 15)
+(since)
+(define-memo (apply3 f) (f 3))
+(apply3 (lambda (y) (* y 2)))
+(apply3 (lambda (y) (* y 5)))
+(memoize 4)
+(define-memo (bad x) (+ x 1) 0)
@@ -0,0 +1,9 @@
+; run: --no-jit
+; run: --closures --no-jit
+; with --no-jit a numeric proc stays with the interpreter however often it is called
+(begin (include tests/stat.scm) 0)
+(define (fact n) (cond ((< n 2) 1) (else (* n (fact (- n 1))))))
+(define (warm n) (cond ((= n 0) 0) (else (begin (fact 10) (warm (- n 1))))))
+(warm 150)
+(stat 'jit-procs)
+(fact 10)
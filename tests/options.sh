@@ -0,0 +1,17 @@
+# clisp's options come in any order before the file; a bad option or number prints the usage and
+# exits with status 2
+clisp=$1
+dir=$(mktemp -d)
+printf '(define (sq x) (* x x))\n(+ (sq 3) (sq 4))\n' >"$dir/t.scm"
+for options in "--closures --no-jit" "--no-jit --closures" "--parallel 2 --pause-us 50 --accumulate" \
+               "--accumulate --pause-us 50 --parallel 2 --closures"; do
+    echo "$options: $($clisp $options "$dir/t.scm" -p </dev/null | tail -3 | head -1)"
+done
+for options in "--parallel x" "--parallel -1" "--pause-us 5x" "--pause-us" "--parallel 99999999999" "--fast" \
+               "--serve 0 socket"; do
+    $clisp $options "$dir/t.scm" </dev/null 2>"$dir/err"
+    echo "$options: status $? $(head -1 "$dir/err")"
+done
+$clisp "$dir/t.scm" -p extra </dev/null 2>/dev/null
+echo "too many arguments: status $?"
+rm -rf "$dir"
@@ -0,0 +1,27 @@
+; run: --parallel 2
+; run: --closures --parallel 2
+; arguments handed to other threads give the values and errors of evaluating them in order
+(begin (include tests/stat.scm) 0)
+(define one (1))
+(define (fibl n l) (cond ((< n 2) (car l)) (else (+ (fibl (- n 1) l) (fibl (- n 2) l)))))
+(fibl 20 one)
+(fibl 21 one)
+(+ (fibl 20 one) (fibl 19 one) 5)
+(list (fibl 20 one) (fibl 21 one) 'x)
+(- (fibl 21 one) (fibl 20 one))
+(define (bad n) (cond ((< n 1) (car)) (else (+ (bad (- n 1)) 1))))
+(+ (fibl 20 one) (bad 3))
+(+ (bad 3) (fibl 20 one))
+(define (lam n) (lambda (x) (+ x n)))
+(define (costly-lam n) (begin (fibl n one) (lam n)))
+(list (fibl 20 one) ((costly-lam 20) 1) (fibl 20 one) 3)
+(define (imp n) (begin (define q n) (fibl n one)))
+(list (imp 20) (imp 20) 1)
+(list (fibl 20 one) (fibl 20 one) (imp 20))
+; the workers collect their own heaps, with the caller's frames left to the caller
+(define (mk n) (lambda (x) (+ x n)))
+(define (churn n l) (cond ((< n 1) (car l)) (else (begin (mk n) (churn (- n 1) l)))))
+(churn 20000 one)
+(+ (churn 20000 one) (churn 20000 one) (churn 20000 one))
+(> (stat 'forked) 0)
+(> (stat 'impure) 0)
@@ -0,0 +1,32 @@
+; calls bind up to four params in inline slots and more in a map, and a frame that defines moves
+; to a map; each shape must see its own arguments, whatever its arity
+(define (zero) (+ 0 0))
+(define (one a) (+ a 0))
+(define (two a b) (- a b))
+(define (three a b c) (- a (- b c)))
+(define (four a b c d) (- a (- b (- c d))))
+(define (five a b c d e) (- a (- b (- c (- d e)))))
+(define (six a b c d e f) (- a (- b (- c (- d (- e f))))))
+(zero)
+(one 1)
+(two 10 3)
+(three 10 3 2)
+(four 10 3 2 1)
+(five 10 3 2 1 7)
+(six 10 3 2 1 7 5)
+(define (adder4 a b c d) (lambda (x) (+ x (+ a (+ b (+ c d))))))
+(define (adder5 a b c d e) (lambda (x) (+ x (+ a (+ b (+ c (+ d e)))))))
+(define add10 (adder4 1 2 3 4))
+(define add15 (adder5 1 2 3 4 5))
+(add10 0)
+(add15 0)
+(define (with-local a b) (begin (define c (* a b)) (lambda (x) (+ x (+ a c)))))
+(define local (with-local 2 3))
+(local 1)
+(define (shadow a b) (let ((a (* a 10)) (c b)) (lambda (x) (+ x (+ a c)))))
+(define shadowed (shadow 1 2))
+(shadowed 100)
+(define (count-down a b c d) (cond ((= a 0) (+ b (+ c d))) (else (count-down (- a 1) (+ b 1) c d))))
+(count-down 1000 0 5 6)
+(define (swap a b) (cond ((< a b) (swap b a)) (else (- a b))))
+(swap 3 10)
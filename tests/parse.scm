@@ -0,0 +1,24 @@
+; each top-level form is parsed into an arena that the next read reuses, so whatever outlives the
+; form, procs, quoted lists and bindings, must still be whole after later forms are read
+(define data '(1 (2 3) ((4 5) 6) ()))
+(define (shape x)
+        ; a comment inside a multiline form
+        (cond ((empty? x) 'empty)
+              (else (cons (car x)
+                          (cdr x)))))
+(define keep (lambda (a b)
+                     (cons a (cons b '(tail of the result)))))
+'(a long quoted form (with (nested (forms inside it)) plus more) to overwrite the arena)
+data
+(shape data)
+(keep 1 2)
+(define nested '((1 2) (3 4) (5 6)))
+(car (cdr nested))
+(define (twice f) (lambda (x) (f (f x))))
+(define add2 (twice (lambda (x) (+ x 1))))
+(define (prefix a b c) (cons a '(fill (the (arena (with (something (new))))))))
+(add2 40)
+(car (car (cdr (cdr data))))
+(begin (define late '(x y z)) late)
+late
+(prefix 0 1 2)
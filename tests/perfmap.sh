@@ -0,0 +1,17 @@
+# the JIT names its code in /tmp/perf-<pid>.map only when CLISP_PERF_MAP is set
+clisp=$1
+dir=$(mktemp -d)
+cat >"$dir/hot.scm" <<'END'
+(define (fact n) (cond ((< n 2) 1) (else (* n (fact (- n 1))))))
+(define (warm n) (cond ((= n 0) 0) (else (begin (fact 10) (warm (- n 1))))))
+(warm 150)
+END
+$clisp "$dir/hot.scm" </dev/null >/dev/null &
+pid=$!
+wait $pid
+[ -f /tmp/perf-$pid.map ] && echo "map without CLISP_PERF_MAP" || echo "no map"
+CLISP_PERF_MAP=1 $clisp "$dir/hot.scm" </dev/null >/dev/null &
+pid=$!
+wait $pid
+sed 's/^[0-9a-f]* [0-9a-f]* //' /tmp/perf-$pid.map
+rm -rf "$dir" /tmp/perf-$pid.map
@@ -0,0 +1,41 @@
+// the --parallel workers across a fork: the child starts workers of its own and hands them calls,
+// the parent's start again after the fork, and each process exits with its workers joined
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "server.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace Environment;
+
+namespace {
+    void sum(Interpreter& interp, ostringstream& out, const string& who) {
+        size_t before = Parallel::forked.load();
+        istringstream in {"(+ (fibl 20 one) (fibl 19 one))\n"};
+        out.str("");
+        Server::run(interp, in, true);
+        cout << who << (Parallel::forked.load() > before? " forked " : " in order ") << out.str() << flush;
+    }
+}
+
+int main() {
+    Parallel::threads = 2;
+    ostringstream out;
+    Interpreter interp {cin, out};
+    istringstream prelude {"(define one (1))\n"
+                           "(define (fibl n l) (cond ((< n 2) (car l)) (else (+ (fibl (- n 1) l) (fibl (- n 2) l)))))\n"
+                           "(+ (fibl 20 one) (fibl 19 one))\n"};   // profiles both calls as costly
+    Server::run(interp, prelude, false);
+    sum(interp, out, "parent");
+    pid_t child = fork();
+    if (child == 0) {
+        sum(interp, out, "child");
+        return 0;
+    }
+    int status;
+    waitpid(child, &status, 0);
+    cout << "child exited " << (WIFEXITED(status)? WEXITSTATUS(status) : -1) << endl;
+    sum(interp, out, "parent");
+}
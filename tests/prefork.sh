@@ -0,0 +1,37 @@
+# clisp --prefork: each connection sends inline expressions or a script path, shuts down its write
+# side and reads the results; every job runs in its own fork of the prelude
+clisp=$1
+dir=$(mktemp -d)
+$clisp --prefork 2 "$dir/socket" funcs.scm >"$dir/totals" 2>/dev/null &
+server=$!
+
+job() {
+    perl -MIO::Socket::UNIX -e '
+        my $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die "connect: $!";
+        print $s $ARGV[1];
+        $s->shutdown(1);
+        print while <$s>;' "$dir/socket" "$1"
+}
+for i in $(seq 50); do job "" >/dev/null 2>&1 && break; sleep 0.1; done
+
+job "(square 4) (define x 5) (+ x 1)"
+echo "-- another job"
+job "x (cube 2)"
+echo "-- a script"
+printf '(define y 3)\n(linear-sum 1 y)\n(undefined 1)\n' >"$dir/script.scm"
+job "$dir/script.scm"
+echo "-- after the script"
+job "y"
+
+echo "-- a client that leaves before its results"
+perl -MIO::Socket::UNIX -e '
+    my $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die "connect: $!";
+    print $s "(fib-naive 18)";
+    close $s;' "$dir/socket"
+job "(square 5)"
+
+kill $server
+wait $server
+grep -c '^worker' "$dir/totals"
+grep -c 'exited' "$dir/totals"
+rm -rf "$dir"
@@ -0,0 +1,41 @@
+// top-level forms that each return a new closure: what a form leaves behind is collected after it,
+// so the resident size stays flat however many forms run
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include "server.h"
+
+using namespace std;
+using namespace Environment;
+
+namespace {
+    long max_rss_kb() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    void forms(Interpreter& interp, int n) {
+        string script;
+        for (int i = 0; i < n; ++i) script += "(make-counter " + to_string(i) + ")\n";
+        istringstream in {script};
+        Server::run(interp, in, false);
+    }
+}
+
+int main() {
+    ostringstream out;
+    Interpreter interp {cin, out};
+    istringstream prelude {"(define (make-counter start) (lambda (step) (+ start step)))\n"
+                           "(define kept (make-counter 40))\n"};
+    Server::run(interp, prelude, false);
+    for (int round = 0; round < 5; ++round) forms(interp, 20000);    // until the old space limit settles
+    long warm = max_rss_kb();
+    for (int round = 0; round < 10; ++round) forms(interp, 20000);
+    long grown = max_rss_kb() - warm;
+    cout << (grown < 16384? "flat" : "grew " + to_string(grown) + "KB") << '\n';
+
+    istringstream last {"(kept 2)\n"};
+    Server::run(interp, last, true);
+    cout << out.str();
+}
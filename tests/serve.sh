@@ -0,0 +1,30 @@
+# clisp --serve: requests and results are length prefixed frames, one result frame per expression,
+# and each connection keeps its own definitions over the shared prelude
+clisp=$1
+client=./clisp-client
+dir=$(mktemp -d)
+$clisp --serve 2 "$dir/socket" funcs.scm >/dev/null 2>&1 &
+server=$!
+for i in $(seq 50); do $client "$dir/socket" "0" >/dev/null 2>&1 && break; sleep 0.1; done
+
+$client "$dir/socket" "(square 4)" "(define x 5) (+ x 1) (cube 2)" "x" "(undefined 1)" "(car)"
+echo "-- another connection"
+$client "$dir/socket" "x" "(define x 7)" "x"
+echo "-- lines from stdin"
+printf '(linear-sum 1 10)\n\n(define (upto n acc) (cond ((= n 0) acc) (else (upto (- n 1) (cons n acc)))))\n(upto 5 ())\n' | $client "$dir/socket"
+echo "-- a result past 64KB"
+$client "$dir/socket" "(define (upto n acc) (cond ((= n 0) acc) (else (upto (- n 1) (cons n acc)))))" \
+    "(define (copies n l acc) (cond ((= n 0) acc) (else (copies (- n 1) l (cons l acc)))))" "(copies 8 (upto 2000 ()) ())" | wc -c
+
+echo "-- a request over the 1MB limit"
+perl -MIO::Socket::UNIX -e '
+    my $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die "connect: $!";
+    print $s pack("N", 16 << 20), "(+ 1 2)";
+    $SIG{ALRM} = sub { print "still open\n"; exit };
+    alarm 5;
+    print <$s> ? "answered\n" : "closed\n";' "$dir/socket"
+$client "$dir/socket" "(square 6)"
+
+kill $server
+wait $server
+rm -rf "$dir"
@@ -0,0 +1,21 @@
+; run: --closures
+; an arithmetic site given only numbers for its first 8 runs reads them as doubles, and goes back for
+; good to taking any value once it is given something else
+(begin (include tests/stat.scm) 0)
+(begin (define specialized (stat 'specialized)) (define despecialized (stat 'despecialized)) 0)
+(define (scale v k) (cond ((= k 0) 'zero) (else (* v k))))
+(define (less a b) (cond ((< a b) 'less) ((= 1 1) 'not-less)))
+(define (run n) (cond ((= n 0) 'done) (else (begin (scale (- n 1) 2) (less (- n 1) 3) (run (- n 1))))))
+(run 20)
+(scale 1.5 4)
+(less 1 2)
+(- (stat 'specialized) specialized)
+(- (stat 'despecialized) despecialized)
+(scale (f64vector 1 2 3) 2)
+(less 'a 'b)
+(scale 3 2)
+(less 5 2)
+(- (stat 'despecialized) despecialized)
+(scale (f64vector 1 2 3) 2)
+(less 'a 'b)
+(- (stat 'despecialized) despecialized)
@@ -0,0 +1,6 @@
+; (stat 'name), one counter from (stats), for the tests
+(define (lookup name pairs)
+        (cond ((empty? pairs) 'none)
+              ((= (car (car pairs)) name) (car (cdr (car pairs))))
+              (else (lookup name (cdr pairs)))))
+(define (stat name) (lookup name (stats)))
@@ -0,0 +1,18 @@
+; run:
+; run: --closures
+; calls in tail position run in constant stack, also inside a parenthesized begin, let or cond
+(define (count n) (cond ((= n 0) 'done) (else (count (- n 1)))))
+(count 300000)
+(define (ch n) (cond ((= n 0) 0) (else (begin 1 (ch (- n 1))))))
+(ch 300000)
+(define (cl n) (cond ((= n 0) 'done) (else (let ((m (- n 1))) (cl m)))))
+(cl 300000)
+(define (cc n) (cond ((= n 0) 'done) (else (cond ((< n 0) 'never) (else (cc (- n 1)))))))
+(cc 300000)
+(define (mutual n) (cond ((= n 0) 'even) (else (other (- n 1)))))
+(define (other n) (cond ((= n 0) 'odd) (else (mutual (- n 1)))))
+(mutual 300001)
+; a parenthesized cond goes on with the clauses after the one that matched, as evlist does, and
+; raises when none does
+((cond ((= 1 1) 5) ((= 1 2) 6)))
+((cond ((= 1 2) 5)))
@@ -0,0 +1,31 @@
+; run:
+; run: --closures
+; f64vectors: element by element arithmetic, reductions, and the errors for operands that do not fit
+(define v (f64vector 1 2 3 4 5 6 7 8 9 10 11))
+(define w (list->f64vector (11 10 9 8 7 6 5 4 3 2 1)))
+(f64vector-length v)
+(f64vector-ref v 0)
+(f64vector-ref v 10)
+(f64vector->list (+ v w))
+(f64vector->list (- v w))
+(f64vector->list (* v 2))
+(f64vector->list (- 12 v))
+(f64vector->list (/ v 2))
+(f64vector->list (+ 1 v w 1))
+(f64vector-sum v)
+(f64vector-dot v w)
+(f64vector-min w)
+(f64vector-max w)
+(f64vector-sum (list->f64vector ()))
+(list->f64vector (5))
+(f64vector->list (f64vector 1 2 3))
+(+ v (f64vector 1 2 3))
+(f64vector-dot v (f64vector 1 2))
+(* (f64vector 1 2) 3 (f64vector 1 2 3))
+(f64vector-min (list->f64vector ()))
+(f64vector-ref v 11)
+(f64vector-ref v 1.5)
+(f64vector-ref v (- 0 1))
+(f64vector-sum (1 2 3))
+(f64vector 1 'a)
+(f64vector-length v w)
@@ -10,34 +10,35 @@ using namespace Parser;
 using namespace Environment;
 
 namespace Driver {
-    void start(bool print_res) {
-        envs.reserve(max_capacity * 4); // reserve to preserve pointers
-        procs.reserve(max_capacity);
-        envs.push_back(e0);
-
+    void start(Interpreter& interp, bool print_res) {
+        Cell_stream& cs = interp.cs;
+        ostream& out = *interp.outstream;
         while (true) {
-            if (print_res) cout << "> ";
+            if (print_res) out << "> ";
             try {
                 chrono::time_point<chrono::system_clock> start, end;
-                auto read = expr(true);
+                auto form = read(interp);
                 start = chrono::system_clock::now();
-                auto res = eval(read, &e0);
+                auto res = eval(interp, form, &interp.e0);
                 end = chrono::system_clock::now();
                 chrono::duration<double> elapsed = chrono::duration_cast<chrono::milliseconds>(end - start);
                 if (print_res) {
-                    cout << res << '\n';    
-                    cout << "Took: " << elapsed.count() << "ms\n";
+                    out << res << '\n';    
+                    out << "Took: " << elapsed.count() << "ms\n";
                 }
+                interp.heap.end_region(res);
                 if (res.kind == Kind::End || cs.eof()) { cs.reset(); if (cs.base()) print_res = true; }
             }
             catch (exception& e) {
-                cout << "Bad expression: " << e.what() << endl;    // continue loop
+                out << "Bad expression: " << e.what() << endl;    // continue loop
             }
         }
     }
 }
 
 int main(int argc, char* argv[]) {
+    Interpreter interp;
+    Cell_stream& cs = interp.cs;
     bool print_res {false};
     switch (argc) {
         case 1:
@@ -56,7 +57,7 @@ int main(int argc, char* argv[]) {
             throw runtime_error("too many arguments");
             return 1;
     }
-    Driver::start(print_res);
+    Driver::start(interp, print_res);
 
     return 0;
 }
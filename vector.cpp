@@ -0,0 +1,215 @@
+#include <cstring>
+#include <stdexcept>
+#include "vector.h"
+
+using namespace std;
+using namespace Lexer;
+
+// each kernel is compiled once per target and resolved when the program loads; elsewhere the
+// compiler's own vectorization of the same loops is all there is
+#if defined(__x86_64__) && defined(__linux__)
+#define KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define KERNEL
+#endif
+
+namespace {
+    typedef double Lanes __attribute__((vector_size(32)));  // one AVX2 register, two SSE2 ones
+
+    // out = a op b element by element; out may be a
+    KERNEL void elementwise(Kind op, const double* a, const double* b, double* out, size_t n) {
+        switch (op) {
+            case Kind::Add: for (size_t i = 0; i < n; ++i) out[i] = a[i] + b[i]; break;
+            case Kind::Sub: for (size_t i = 0; i < n; ++i) out[i] = a[i] - b[i]; break;
+            case Kind::Mul: for (size_t i = 0; i < n; ++i) out[i] = a[i] * b[i]; break;
+            default: for (size_t i = 0; i < n; ++i) out[i] = a[i] / b[i]; break;
+        }
+    }
+
+    // out = a op k, or k op a where k comes first
+    KERNEL void broadcast(Kind op, const double* a, double k, bool first, double* out, size_t n) {
+        switch (op) {
+            case Kind::Add: for (size_t i = 0; i < n; ++i) out[i] = a[i] + k; break;
+            case Kind::Mul: for (size_t i = 0; i < n; ++i) out[i] = a[i] * k; break;
+            case Kind::Sub:
+                if (first) for (size_t i = 0; i < n; ++i) out[i] = k - a[i];
+                else for (size_t i = 0; i < n; ++i) out[i] = a[i] - k;
+                break;
+            default:
+                if (first) for (size_t i = 0; i < n; ++i) out[i] = k / a[i];
+                else for (size_t i = 0; i < n; ++i) out[i] = a[i] / k;
+                break;
+        }
+    }
+
+    // reductions keep two vectors of partial results, so consecutive adds do not wait on each other
+    KERNEL double sum(const double* a, size_t n) {
+        Lanes s {}, t {};
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            Lanes x, y;
+            memcpy(&x, a + i, sizeof x);
+            memcpy(&y, a + i + 4, sizeof y);
+            s += x;
+            t += y;
+        }
+        s += t;
+        double res = (s[0] + s[1]) + (s[2] + s[3]);
+        for (; i < n; ++i) res += a[i];
+        return res;
+    }
+
+    KERNEL double dot(const double* a, const double* b, size_t n) {
+        Lanes s {}, t {};
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            Lanes x, y, u, v;
+            memcpy(&x, a + i, sizeof x);
+            memcpy(&y, a + i + 4, sizeof y);
+            memcpy(&u, b + i, sizeof u);
+            memcpy(&v, b + i + 4, sizeof v);
+            s += x * u;
+            t += y * v;
+        }
+        s += t;
+        double res = (s[0] + s[1]) + (s[2] + s[3]);
+        for (; i < n; ++i) res += a[i] * b[i];
+        return res;
+    }
+
+    KERNEL double extreme(const double* a, size_t n, bool most) {  // n > 0, the least or the most
+        Lanes m = {a[0], a[0], a[0], a[0]};
+        size_t i = 0;
+        if (most) for (; i + 4 <= n; i += 4) { Lanes x; memcpy(&x, a + i, sizeof x); m = x > m? x : m; }
+        else for (; i + 4 <= n; i += 4) { Lanes x; memcpy(&x, a + i, sizeof x); m = x < m? x : m; }
+        double res = m[0];
+        for (int j = 1; j < 4; ++j) if (most? m[j] > res : m[j] < res) res = m[j];
+        for (; i < n; ++i) if (most? a[i] > res : a[i] < res) res = a[i];
+        return res;
+    }
+
+    const vector<double>& f64vector(const Cell& c, const char* prim) {
+        if (c.kind != Kind::F64vector) throw runtime_error(string{prim} + " expects an f64vector");
+        return *boost::get<F64vector>(c.data);
+    }
+
+    void arity(Parser::Values args, size_t n, const char* prim) {
+        if (args.size() != n) throw runtime_error(string{prim} + " expects " + to_string(n) + (n == 1? " argument" : " arguments"));
+    }
+
+    F64vector numbers(const Cell* p, const Cell* last, const char* prim) {
+        auto res = make_shared<vector<double>>();
+        res->reserve(last - p);
+        for (; p != last; ++p) {
+            if (p->kind != Kind::Number) throw runtime_error(string{prim} + " expects numbers");
+            res->push_back(boost::get<double>(p->data));
+        }
+        return res;
+    }
+}
+
+bool Vector::primitive(Kind k) {
+    switch (k) {
+        case Kind::F64: case Kind::F64_list: case Kind::List_f64: case Kind::F64_ref: case Kind::F64_length:
+        case Kind::F64_dot: case Kind::F64_sum: case Kind::F64_min: case Kind::F64_max:
+            return true;
+        default: return false;
+    }
+}
+
+Cell Vector::apply(const Cell& prim, Parser::Values args) {
+    switch (prim.kind) {
+        case Kind::F64: return numbers(args.begin(), args.end(), "f64vector");
+        case Kind::List_f64: {  // a list of one number is that number, as evlist collapses it
+            arity(args, 1, "list->f64vector");
+            if (args[0].kind != Kind::Expr) return numbers(args.begin(), args.end(), "list->f64vector");
+            const List& list = boost::get<List>(args[0].data);
+            return numbers(list.data(), list.data() + list.size(), "list->f64vector");
+        }
+        case Kind::F64_list: {
+            arity(args, 1, "f64vector->list");
+            const vector<double>& v = f64vector(args[0], "f64vector->list");
+            return List(v.begin(), v.end());
+        }
+        case Kind::F64_ref: {
+            arity(args, 2, "f64vector-ref");
+            const vector<double>& v = f64vector(args[0], "f64vector-ref");
+            if (args[1].kind != Kind::Number) throw runtime_error("f64vector-ref expects an index");
+            double i = boost::get<double>(args[1].data);
+            if (!(i >= 0 && i < v.size()) || i != size_t(i)) throw runtime_error("f64vector-ref index out of range");
+            return {v[size_t(i)]};
+        }
+        case Kind::F64_length:
+            arity(args, 1, "f64vector-length");
+            return {double(f64vector(args[0], "f64vector-length").size())};
+        case Kind::F64_dot: {
+            arity(args, 2, "f64vector-dot");
+            const vector<double>& v = f64vector(args[0], "f64vector-dot");
+            const vector<double>& w = f64vector(args[1], "f64vector-dot");
+            if (v.size() != w.size()) throw runtime_error("f64vector lengths differ");
+            return {dot(v.data(), w.data(), v.size())};
+        }
+        case Kind::F64_sum: {
+            arity(args, 1, "f64vector-sum");
+            const vector<double>& v = f64vector(args[0], "f64vector-sum");
+            return {sum(v.data(), v.size())};
+        }
+        case Kind::F64_min: case Kind::F64_max: {
+            bool most = prim.kind == Kind::F64_max;
+            const char* name = most? "f64vector-max" : "f64vector-min";
+            arity(args, 1, name);
+            const vector<double>& v = f64vector(args[0], name);
+            if (v.empty()) throw runtime_error(string{name} + " of an empty f64vector");
+            return {extreme(v.data(), v.size(), most)};
+        }
+        default: throw runtime_error("Mismatch in Vector::apply");
+    }
+}
+
+bool Vector::holds(Parser::Values args) {
+    for (auto& c : args) if (c.kind == Kind::F64vector) return true;
+    return false;
+}
+
+// folds from the left as apply_prim does, into one new vector once the first one comes up
+Cell Vector::arithmetic(const Cell& prim, Parser::Values args) {
+    shared_ptr<vector<double>> res;
+    const double* value = nullptr;  // the vector so far, in an argument or res
+    size_t n = 0;
+    double x = 0;   // the number so far, while there is no vector
+    for (auto p = args.begin(); p != args.end(); ++p) {
+        if (p->kind != Kind::F64vector) {
+            double y = boost::get<double>(p->data);
+            if (p == args.begin()) x = y;
+            else if (value) {
+                if (!res) res = make_shared<vector<double>>(n);
+                broadcast(prim.kind, value, y, false, res->data(), n);
+                value = res->data();
+            }
+            else switch (prim.kind) {
+                case Kind::Add: x += y; break;
+                case Kind::Sub: x -= y; break;
+                case Kind::Mul: x *= y; break;
+                default: x /= y; break;
+            }
+            continue;
+        }
+        const vector<double>& v = *boost::get<F64vector>(p->data);
+        if (p == args.begin()) { value = v.data(); n = v.size(); continue; }
+        if (value && v.size() != n) throw runtime_error("f64vector lengths differ");
+        if (!res) res = make_shared<vector<double>>(v.size());
+        if (value) elementwise(prim.kind, value, v.data(), res->data(), n);
+        else broadcast(prim.kind, v.data(), x, true, res->data(), n = v.size());
+        value = res->data();
+    }
+    if (res) return F64vector{std::move(res)};
+    return boost::get<F64vector>(args[0].data);   // (+ v) and the like
+}
+
+const char* Vector::isa() {
+#if defined(__x86_64__) && defined(__linux__)
+    return __builtin_cpu_supports("avx2")? "avx2" : "sse2";
+#else
+    return "generic";
+#endif
+}
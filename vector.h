@@ -0,0 +1,20 @@
+#ifndef clispp_vector
+#define clispp_vector
+#include "parser_impl.h"
+
+// f64vectors: doubles stored contiguously, made by (f64vector x...) or (list->f64vector list) and
+// read back by (f64vector->list v), (f64vector-ref v i) and (f64vector-length v). + - * / take them
+// element by element, with a number operand applied to every element, and (f64vector-dot v w),
+// (f64vector-sum v), (f64vector-min v) and (f64vector-max v) reduce them. The kernels are built for
+// AVX2 and for the baseline SSE2, the loader picks the one the CPU runs; sums and dot products
+// add in lanes, so they may round differently from adding the elements in order
+namespace Vector {
+    using namespace Lexer;
+
+    bool primitive(Kind k);     // one of the f64vector primitives, applied by apply
+    Cell apply(const Cell& prim, Parser::Values args);
+    bool holds(Parser::Values args);    // an f64vector among arithmetic's arguments, which arithmetic then takes
+    Cell arithmetic(const Cell& prim, Parser::Values args);
+    const char* isa();      // the kernels this CPU runs
+}
+#endif
@@ -10,24 +10,18 @@ using namespace Lexer;
 using namespace Parser;
 using namespace Environment;
 
-static void init_env() {
-	envs.reserve(max_capacity * 4); // reserve to preserve pointers
-	procs.reserve(max_capacity);
-	envs.push_back(e0);
-}
-
 string expr_str(string input) {
-	static bool inited {false};
-	if (!inited) { init_env(); inited = true; }
+	static Interpreter interp;	// definitions persist between calls
 	istringstream in(input);
 	ostringstream out;
-	outstream = &out;
-	cs.set_input(in);
+	interp.outstream = &out;
+	interp.cs.set_input(in);
 	while (true) {
 		try {
-			auto res = eval(expr(true), &e0);
-            if (res.kind == Kind::End || cs.eof()) break;
-			*outstream << res;
+			auto res = eval(interp, read(interp), &interp.e0);
+            if (res.kind == Kind::End || interp.cs.eof()) break;
+			out << res;
+			interp.heap.end_region(res);
 		}
 		catch (exception& e) {
 			return e.what();    // continue loop
@@ -38,4 +32,4 @@ string expr_str(string input) {
 
 EMSCRIPTEN_BINDINGS(my_module) {
 	emscripten::function("expr_str", &expr_str);
-}
\ No newline at end of file
+}